@@ -1,10 +1,384 @@
 #include "actions.hpp"
+#include "ignore.hpp"
+#include "copier.hpp"
+#include "executor.hpp"
+#include "uring.hpp"
+#include "remover.hpp"
+#include "hasher.hpp"
+#include "duplicates.hpp"
+#include "catalog.hpp"
 #include <iostream>
 #include <algorithm>
 #include <chrono>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace actions {
 
+namespace {
+
+Resources shared_resources;
+
+utils::StreamOptions make_stream_options(const Command& cmd) {
+    utils::StreamOptions options;
+    options.recursive = cmd.recursive;
+    options.threads = cmd.threads;
+    options.use_ignore_files = cmd.use_ignore_files;
+    // Operations run relative to the scan's directory descriptors
+    options.keep_open = !cmd.dry_run;
+    if (!cmd.exclude.empty()) {
+        // Command excludes are case-insensitive like the main pattern
+        auto excludes = std::make_shared<utils::IgnoreList>(nullptr, "");
+        for (const auto& pattern : cmd.exclude) {
+            excludes->add_rule(pattern, true);
+        }
+        options.ignore = std::move(excludes);
+    }
+    return options;
+}
+
+// Files handed to one executor task; enough to amortize the queue handoff
+constexpr size_t kFilesPerTask = 64;
+
+executor::ExecutorOptions make_executor_options(const Command& cmd) {
+    executor::ExecutorOptions options;
+    options.threads = cmd.io_threads;
+    if (cmd.device_limit > 0) options.device_limit = cmd.device_limit;
+    if (cmd.slow_device_limit > 0) options.slow_device_limit = cmd.slow_device_limit;
+    return options;
+}
+
+copier::CopyOptions make_copy_options(const Command& cmd) {
+    copier::CopyOptions options;
+    if (cmd.large_file_threshold) options.parallel_threshold = *cmd.large_file_threshold;
+    if (cmd.copy_workers > 0) options.workers = cmd.copy_workers;
+    // Incremental copies keep the source mtime so the next run sees them as unchanged
+    options.preserve_times = cmd.sync;
+    options.delta = cmd.delta;
+    return options;
+}
+
+// One ring per executor worker, reused for every chunk it copies. nullptr if
+// the ring can't be set up (e.g. locked memory limits), so callers fall back.
+uring::BatchCopier* thread_copier(unsigned queue_depth) {
+    thread_local std::unique_ptr<uring::BatchCopier> ring;
+    thread_local unsigned ring_depth = 0;
+    if (queue_depth == 0) queue_depth = uring::BatchCopier::kDefaultQueueDepth;
+    if (!ring || ring_depth != queue_depth) {
+        try {
+            ring = std::make_unique<uring::BatchCopier>(queue_depth);
+            ring_depth = queue_depth;
+        } catch (const std::exception&) {
+            ring.reset();
+        }
+    }
+    return ring.get();
+}
+
+// Metadata counterpart of thread_copier. Without io_uring (or if the kernel
+// refuses it) the same batch runs plain syscalls, so callers have one path.
+// The ring is only set up on threads that ran an io_uring command.
+uring::MetadataBatch& thread_metadata_batch(bool use_io_uring) {
+    thread_local std::unique_ptr<uring::MetadataBatch> ring_batch;
+    thread_local uring::MetadataBatch syscall_batch(0);
+    if (!use_io_uring) return syscall_batch;
+    if (!ring_batch) ring_batch = std::make_unique<uring::MetadataBatch>();
+    return *ring_batch;
+}
+
+// create_directories through io_uring: one batch of STATX calls finds the
+// deepest existing ancestor, then the missing levels are created by a chain of
+// linked MKDIRATs. Returns 0 or an errno value.
+int create_directories_batched(const std::filesystem::path& path, bool use_io_uring) {
+    std::vector<std::filesystem::path> levels;    // path first, root-most last
+    for (auto p = path.lexically_normal(); !p.empty() && p != p.root_path(); p = p.parent_path()) {
+        if (p.filename().empty()) continue;      // trailing separator
+        levels.push_back(p);
+    }
+    
+    auto& batch = thread_metadata_batch(use_io_uring);
+    std::vector<struct statx> stats(levels.size());
+    for (size_t i = 0; i < levels.size(); ++i) {
+        batch.statx(AT_FDCWD, levels[i].string(), 0, STATX_TYPE, &stats[i]);
+    }
+    std::vector<int> found = batch.run();
+    
+    size_t missing = 0;
+    while (missing < levels.size() && found[missing] == ENOENT) {
+        missing++;
+    }
+    if (missing < levels.size()) {
+        if (found[missing] != 0) return found[missing];
+        if (!S_ISDIR(stats[missing].stx_mode)) return missing == 0 ? EEXIST : ENOTDIR;
+    }
+    
+    for (size_t i = missing; i-- > 0;) {
+        batch.mkdir(AT_FDCWD, levels[i].string());
+        if (i > 0) batch.link();
+    }
+    std::vector<int> created = batch.run();
+    for (size_t i = 0; i < created.size(); ++i) {
+        // Someone else creating a level in the meantime is fine
+        if (created[i] == EEXIST && std::filesystem::is_directory(levels[missing - 1 - i])) continue;
+        if (created[i] != 0) return created[i];
+    }
+    return 0;
+}
+
+// Files from one directory handed to a single executor task
+struct FileChunk {
+    std::shared_ptr<const scanner::Directory> dir;
+    std::vector<std::string> names;
+    dev_t device = 0;             // st_dev of the directory (0 if it couldn't be stat'ed)
+
+    std::filesystem::path path(size_t i) const { return dir->path / names[i]; }
+
+    // Arguments for *at() calls: the scan's open directory and the bare name, so
+    // the kernel doesn't walk the full path again and a directory renamed since
+    // the scan can't redirect the operation. Falls back to the full path.
+    int at_fd() const { return dir->dir_fd() >= 0 ? dir->dir_fd() : AT_FDCWD; }
+    std::string at_name(size_t i) const { return dir->dir_fd() >= 0 ? names[i] : path(i).string(); }
+};
+
+using ChunkHandler = std::function<void(const FileChunk&)>;
+
+// Destination directory opened once per command; new entries are created
+// relative to it
+class Destination {
+public:
+    explicit Destination(const std::filesystem::path& path)
+        : path_(path), fd_(scanner::open_directory(path)) {}
+
+    int at_fd() const { return fd_.get() >= 0 ? fd_.get() : AT_FDCWD; }
+    std::string at_name(const std::string& name) const {
+        return fd_.get() >= 0 ? name : (path_ / name).string();
+    }
+    std::filesystem::path path(const std::string& name) const { return path_ / name; }
+
+private:
+    std::filesystem::path path_;
+    scanner::FileDescriptor fd_;
+};
+
+// A fresh name in the destination for a copy that isn't complete yet
+std::string temporary_name() {
+    static std::atomic<uint64_t> counter{0};
+    return ".smartfilecmd-" + std::to_string(getpid()) + "-" + std::to_string(counter++) + ".tmp";
+}
+
+// Size and mtime of a regular file already in the destination
+struct DestEntry {
+    uint64_t size = 0;
+    struct timespec mtime = {};
+};
+using DestListing = std::unordered_map<std::string, DestEntry>;
+
+// Reads the destination directory once for incremental copies: names from
+// getdents, then one statx batch relative to the open directory, so deciding
+// whether a file changed is a hash lookup instead of a path stat per file
+DestListing list_destination(const Destination& dest, bool use_io_uring) {
+    DestListing listing;
+    int dir_fd = dest.at_fd();
+    if (dir_fd == AT_FDCWD) return listing;    // nothing there yet
+    
+    std::vector<std::string> names;
+    scanner::DirectoryReader reader;
+    reader.read(dir_fd, [&](std::span<scanner::DirEntry> batch) {
+        for (const auto& entry : batch) {
+            if (entry.type == scanner::EntryType::Regular || entry.type == scanner::EntryType::Unknown) {
+                names.emplace_back(entry.name);
+            }
+        }
+    });
+    
+    auto& batch = thread_metadata_batch(use_io_uring);
+    std::vector<struct statx> stats(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        batch.statx(dir_fd, names[i], AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_SIZE | STATX_MTIME, &stats[i]);
+    }
+    std::vector<int> found = batch.run();
+    
+    listing.reserve(names.size());
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (found[i] != 0 || !S_ISREG(stats[i].stx_mode)) continue;
+        DestEntry entry;
+        entry.size = stats[i].stx_size;
+        entry.mtime = {static_cast<time_t>(stats[i].stx_mtime.tv_sec), static_cast<long>(stats[i].stx_mtime.tv_nsec)};
+        listing.emplace(std::move(names[i]), entry);
+    }
+    return listing;
+}
+
+std::filesystem::filesystem_error errno_error(int err, const char* what, const std::filesystem::path& path,
+                                              const std::filesystem::path& other = {}) {
+    std::error_code ec(err, std::generic_category());
+    return other.empty() ? std::filesystem::filesystem_error(what, path, ec)
+                         : std::filesystem::filesystem_error(what, path, other, ec);
+}
+
+// Streams every file under the command's source that matches its pattern into
+// handle, in chunks of up to kFilesPerTask names from one directory, filling in
+// the scan counters of result as it goes. Files already in dest_path are
+// skipped: the walk is still running while files land there.
+//
+// handle runs on executor workers, several at once, limited per source and
+// destination device; it has to synchronize anything it shares. Dry runs only
+// count matches and never call it.
+void for_each_matching_file(const Command& cmd, const std::filesystem::path& source_path,
+                            const std::filesystem::path& dest_path, utils::FileOpResult& result,
+                            const ChunkHandler& handle) {
+    std::string dest_rel;
+    if (!dest_path.empty()) {
+        auto rel = dest_path.lexically_normal().lexically_relative(source_path.lexically_normal());
+        if (!rel.empty() && rel != "." && *rel.begin() != "..") {
+            dest_rel = rel.string();
+        }
+    }
+    
+    // Compiled once and shared read-only by the walker threads
+    auto compiled = utils::compile_pattern(cmd.pattern);
+    const utils::PatternMatcher& matcher = *compiled;
+    
+    // Metadata predicates only run once the cheap name match has passed
+    const utils::MetadataFilter metadata(cmd.filters);
+    
+    utils::FileFilter filter;
+    if (!dest_rel.empty() || !metadata.empty()) {
+        filter = [&](int dir_fd, const scanner::Directory& dir, const scanner::DirEntry& entry,
+                     const struct stat* known) {
+            if (!dest_rel.empty() && dir.rel == dest_rel) {
+                return false;
+            }
+            return metadata.matches(dir_fd, entry.name.data(), known);
+        };
+    }
+    
+    // Tasks may still be running when the scan finishes, so scan errors are
+    // merged only after the executor has drained
+    std::vector<std::string> scan_errors;
+    utils::StreamStats stats;
+    
+    // With an index, directories it still has valid listings for aren't read
+    // again; the walk needs the normalized paths the catalog is keyed by
+    utils::StreamOptions stream_options = make_stream_options(cmd);
+    std::unique_ptr<catalog::Catalog> index;
+    std::filesystem::path walk_path = source_path;
+    if (cmd.use_index || (shared_resources.share_listings && shared_resources.catalogs)) {
+        walk_path = catalog::normalize(source_path);
+        if (shared_resources.catalogs) {
+            stream_options.cache = shared_resources.catalogs(walk_path);
+        }
+        if (!stream_options.cache && cmd.use_index) {
+            index = catalog::open_for(walk_path);
+            stream_options.cache = index.get();
+        }
+    }
+    
+    if (cmd.dry_run) {
+        stats = utils::stream_files(walk_path, stream_options, matcher, filter,
+                                    [](utils::FileBatch&) {}, &scan_errors);
+    } else {
+        std::vector<dev_t> dest_devices;
+        struct stat dest_st;
+        if (!dest_path.empty() && stat(dest_path.c_str(), &dest_st) == 0) {
+            dest_devices.push_back(dest_st.st_dev);
+        }
+        
+        std::shared_ptr<executor::Executor> leased;
+        std::optional<executor::Executor> owned;
+        if (shared_resources.executors) {
+            leased = shared_resources.executors->acquire(make_executor_options(cmd));
+        } else {
+            owned.emplace(make_executor_options(cmd));
+        }
+        executor::Executor& pool = leased ? *leased : *owned;
+        stats = utils::stream_files(walk_path, stream_options, matcher, filter,
+            [&](utils::FileBatch& batch) {
+                // Every file in a batch shares the directory's device
+                std::vector<dev_t> devices = dest_devices;
+                dev_t source_device = 0;
+                struct stat dir_st;
+                int dir_fd = batch.dir->dir_fd();
+                if ((dir_fd >= 0 ? fstat(dir_fd, &dir_st) : stat(batch.dir->path.c_str(), &dir_st)) == 0) {
+                    source_device = dir_st.st_dev;
+                    if (std::find(devices.begin(), devices.end(), source_device) == devices.end()) {
+                        devices.push_back(source_device);
+                    }
+                }
+                
+                for (size_t first = 0; first < batch.names.size(); first += kFilesPerTask) {
+                    size_t last = std::min(first + kFilesPerTask, batch.names.size());
+                    FileChunk chunk{batch.dir, {}, source_device};
+                    chunk.names.assign(std::make_move_iterator(batch.names.begin() + first),
+                                       std::make_move_iterator(batch.names.begin() + last));
+                    pool.submit(devices, [&handle, chunk = std::move(chunk)] { handle(chunk); });
+                }
+            }, &scan_errors);
+        pool.wait();
+    }
+    
+    if (index) {
+        if (int err = index->save(); err != 0) {
+            scan_errors.push_back("Failed to save index " + index->file().string() + ": " + std::strerror(err));
+        }
+    }
+    result.errors.insert(result.errors.end(), scan_errors.begin(), scan_errors.end());
+    result.files_scanned = stats.files_scanned;
+    result.files_matched = stats.files_matched;
+}
+
+// Directories below source_path whose name (or root-relative path, for path
+// patterns) matches the command's pattern. A match is not descended into, since
+// its whole tree goes; without --recursive only the source's own subdirectories
+// are candidates. scanned counts the directories considered.
+std::vector<std::filesystem::path> find_matching_directories(const Command& cmd,
+                                                             const std::filesystem::path& source_path,
+                                                             size_t& scanned,
+                                                             std::vector<std::string>& errors) {
+    auto compiled = utils::compile_pattern(cmd.pattern);
+    const utils::PatternMatcher& matcher = *compiled;
+    bool recursive = cmd.recursive || matcher.is_path_pattern();
+    
+    scanner::WalkOptions options;
+    options.threads = recursive ? scanner::resolve_thread_count(cmd.threads) : 1;
+    options.ignore = make_stream_options(cmd).ignore;
+    if (cmd.use_ignore_files) {
+        options.ignore_files = utils::kIgnoreFileNames;
+    }
+    
+    std::mutex matches_mutex;
+    std::vector<std::filesystem::path> matches;
+    std::atomic<size_t> considered{0};
+    options.descend = [&](const scanner::Directory& parent, std::string_view name, const std::string& rel) {
+        considered++;
+        if (matcher.matches(matcher.is_path_pattern() ? std::string_view(rel) : name)) {
+            std::lock_guard<std::mutex> lock(matches_mutex);
+            matches.push_back(parent.path / name);
+            return false;
+        }
+        if (!recursive) return false;
+        return !matcher.is_path_pattern() || matcher.may_match_under(rel);
+    };
+    
+    auto walk_errors = scanner::walk(source_path, options,
+        [](size_t, int, const std::shared_ptr<const scanner::Directory>&, std::span<const scanner::DirEntry>) {});
+    errors.insert(errors.end(), walk_errors.begin(), walk_errors.end());
+    scanned = considered.load();
+    
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+} // namespace
+
 utils::FileOpResult move_files(const Command& cmd) {
     utils::FileOpResult result;
     result.operation = "move";
@@ -27,54 +401,111 @@ utils::FileOpResult move_files(const Command& cmd) {
             return result;
         }
         
-        // Scan for matching files
-        std::vector<std::filesystem::path> files;
-        if (cmd.recursive) {
-            files = utils::scan_directory_recursive(source_path);
-        } else {
-            files = utils::scan_directory(source_path);
-        }
+        // rename() can't cross filesystems. Directories on another device than
+        // the destination are known from the scan, so their files go straight
+        // to copy + unlink instead of failing with EXDEV one by one.
+        const Destination dest(dest_path);
+        struct stat dest_st;
+        dev_t dest_device = stat(dest_path.c_str(), &dest_st) == 0 ? dest_st.st_dev : 0;
+        copier::CopyOptions copy_options = make_copy_options(cmd);
+        copy_options.preserve_times = true;
         
-        // Filter files by pattern
-        std::vector<std::filesystem::path> matching_files;
-        for (const auto& file : files) {
-            if (utils::matches_pattern(file.filename().string(), cmd.pattern)) {
-                matching_files.push_back(file);
-            }
-        }
+        // Files are moved on the executor as the scan streams them in
+        std::atomic<int> moved_count{0};
+        std::mutex output_mutex;   // guards result.errors and stderr
         
-        result.files_scanned = files.size();
-        result.files_matched = matching_files.size();
+        auto move_across_devices = [&](const FileChunk& chunk, size_t i) {
+            // Copied under a name of our own and renamed into place once
+            // complete, so a failed copy never costs a file already there
+            std::string dest_name = dest.at_name(chunk.names[i]);
+            std::string temp_name = temporary_name();
+            std::string temp = dest.at_name(temp_name);
+            int temp_fd = openat(dest.at_fd(), temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+            if (temp_fd < 0) {
+                int err = errno;
+                throw errno_error(err, "cannot create", dest.path(temp_name));
+            }
+            close(temp_fd);
+            try {
+                copier::copy_file_at(chunk.at_fd(), chunk.at_name(i).c_str(), dest.at_fd(), temp.c_str(),
+                                     copy_options);
+                if (cmd.verify && !copier::same_contents(chunk.path(i), dest.path(temp_name))) {
+                    throw std::runtime_error("copy does not match the source");
+                }
+                if (renameat(dest.at_fd(), temp.c_str(), dest.at_fd(), dest_name.c_str()) != 0) {
+                    int err = errno;
+                    throw errno_error(err, "cannot rename", dest.path(temp_name), dest.path(chunk.names[i]));
+                }
+            } catch (...) {
+                // Never leave a partial copy behind; the source is untouched
+                unlinkat(dest.at_fd(), temp.c_str(), 0);
+                throw;
+            }
+            if (unlinkat(chunk.at_fd(), chunk.at_name(i).c_str(), 0) != 0) {
+                int err = errno;
+                throw errno_error(err, "cannot remove", chunk.path(i));
+            }
+        };
         
-        if (cmd.dry_run) {
-            result.message = "Would move " + std::to_string(matching_files.size()) + " files";
-            result.success = true;
-            return result;
-        }
+        auto move_failed = [&](const std::filesystem::path& file, const char* what) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            if (cmd.verbose) {
+                std::cerr << "Error moving " << file << ": " << what << std::endl;
+            }
+            result.errors.push_back("Failed to move " + file.string() + ": " + what);
+        };
         
-        // Move files
-        int moved_count = 0;
-        for (const auto& file : matching_files) {
-            try {
-                std::filesystem::path dest_file = dest_path / file.filename();
-                
-                if (cmd.verbose) {
-                    std::cerr << "Moving: " << file << " → " << dest_file << std::endl;
+        for_each_matching_file(cmd, source_path, dest_path, result, [&](const FileChunk& chunk) {
+            bool cross_device = dest_device != 0 && chunk.device != 0 && chunk.device != dest_device;
+            
+            // Same filesystem: the chunk's renames go out as one batch
+            std::vector<int> renamed(chunk.names.size(), EXDEV);
+            if (!cross_device) {
+                auto& batch = thread_metadata_batch(cmd.use_io_uring);
+                for (size_t i = 0; i < chunk.names.size(); ++i) {
+                    if (cmd.verbose) {
+                        std::lock_guard<std::mutex> lock(output_mutex);
+                        std::cerr << "Moving: " << chunk.path(i) << " → " << dest.path(chunk.names[i]) << std::endl;
+                    }
+                    batch.rename(chunk.at_fd(), chunk.at_name(i), dest.at_fd(), dest.at_name(chunk.names[i]));
                 }
-                
-                std::filesystem::rename(file, dest_file);
-                moved_count++;
-                
-            } catch (const std::exception& e) {
-                if (cmd.verbose) {
-                    std::cerr << "Error moving " << file << ": " << e.what() << std::endl;
+                renamed = batch.run();
+            }
+            
+            for (size_t i = 0; i < chunk.names.size(); ++i) {
+                std::filesystem::path file = chunk.path(i);
+                try {
+                    if (renamed[i] == 0) {
+                        moved_count++;
+                        continue;
+                    }
+                    // Bind mounts share st_dev but still refuse rename with EXDEV
+                    if (renamed[i] != EXDEV) {
+                        throw errno_error(renamed[i], "cannot rename", file, dest.path(chunk.names[i]));
+                    }
+                    
+                    if (cmd.verbose) {
+                        std::lock_guard<std::mutex> lock(output_mutex);
+                        std::cerr << "Moving: " << file << " → " << dest.path(chunk.names[i])
+                                  << " (copy + unlink)" << std::endl;
+                    }
+                    move_across_devices(chunk, i);
+                    moved_count++;
+                    
+                } catch (const std::exception& e) {
+                    move_failed(file, e.what());
                 }
-                result.errors.push_back("Failed to move " + file.string() + ": " + e.what());
             }
+        });
+        
+        if (cmd.dry_run) {
+            result.message = "Would move " + std::to_string(result.files_matched) + " files";
+            result.success = true;
+            return result;
         }
         
-        result.files_affected = moved_count;
-        result.message = "Successfully moved " + std::to_string(moved_count) + " files";
+        result.files_affected = moved_count.load();
+        result.message = "Successfully moved " + std::to_string(moved_count.load()) + " files";
         result.success = true;
         
     } catch (const std::exception& e) {
@@ -108,54 +539,150 @@ utils::FileOpResult copy_files(const Command& cmd) {
             return result;
         }
         
-        // Scan for matching files
-        std::vector<std::filesystem::path> files;
-        if (cmd.recursive) {
-            files = utils::scan_directory_recursive(source_path);
-        } else {
-            files = utils::scan_directory(source_path);
-        }
+        // Files are copied on the executor as the scan streams them in; large
+        // ones additionally split into ranges copied by their own threads
+        const Destination dest(dest_path);
+        const copier::CopyOptions copy_options = make_copy_options(cmd);
+        std::atomic<int> copied_count{0};
+        std::atomic<int> unchanged_count{0};
+        std::mutex output_mutex;   // guards result.errors and stderr
+        
+        // Sync mode compares against the destination as it was before this run
+        const DestListing listing = cmd.sync && !cmd.dry_run ? list_destination(dest, cmd.use_io_uring)
+                                                             : DestListing{};
         
-        // Filter files by pattern
-        std::vector<std::filesystem::path> matching_files;
-        for (const auto& file : files) {
-            if (utils::matches_pattern(file.filename().string(), cmd.pattern)) {
-                matching_files.push_back(file);
+        // Whether the file is new or changed; fills in src_st (sync mode only)
+        auto needs_copy = [&](const FileChunk& chunk, size_t i, struct stat& src_st) {
+            if (fstatat(chunk.at_fd(), chunk.at_name(i).c_str(), &src_st, 0) != 0) {
+                return true;    // the copy reports the error
             }
-        }
+            auto it = listing.find(chunk.names[i]);
+            if (it == listing.end() || it->second.size != static_cast<uint64_t>(src_st.st_size)) {
+                return true;
+            }
+            if (cmd.checksum) {
+                try {
+                    return !copier::same_contents(chunk.path(i), dest.path(chunk.names[i]));
+                } catch (const std::filesystem::filesystem_error&) {
+                    return true;
+                }
+            }
+            return it->second.mtime.tv_sec != src_st.st_mtim.tv_sec ||
+                   it->second.mtime.tv_nsec != src_st.st_mtim.tv_nsec;
+        };
         
-        result.files_scanned = files.size();
-        result.files_matched = matching_files.size();
+        auto skip_unchanged = [&](const FileChunk& chunk, size_t i) {
+            unchanged_count++;
+            if (cmd.verbose) {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cerr << "Unchanged: " << chunk.path(i) << std::endl;
+            }
+        };
         
-        if (cmd.dry_run) {
-            result.message = "Would copy " + std::to_string(matching_files.size()) + " files";
-            result.success = true;
-            return result;
-        }
+        auto copy_failed = [&](const std::filesystem::path& file, const char* what) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            if (cmd.verbose) {
+                std::cerr << "Error copying " << file << ": " << what << std::endl;
+            }
+            result.errors.push_back("Failed to copy " + file.string() + ": " + what);
+        };
         
-        // Copy files
-        int copied_count = 0;
-        for (const auto& file : matching_files) {
+        auto copy_one = [&](const FileChunk& chunk, size_t i) {
+            std::filesystem::path file = chunk.path(i);
             try {
-                std::filesystem::path dest_file = dest_path / file.filename();
+                struct stat src_st;
+                if (cmd.sync && !needs_copy(chunk, i, src_st)) {
+                    skip_unchanged(chunk, i);
+                    return;
+                }
                 
                 if (cmd.verbose) {
-                    std::cerr << "Copying: " << file << " → " << dest_file << std::endl;
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << "Copying: " << file << " → " << dest.path(chunk.names[i]) << std::endl;
                 }
                 
-                std::filesystem::copy_file(file, dest_file, std::filesystem::copy_options::overwrite_existing);
+                // Reflink, then in-kernel copy, then a buffered loop
+                copier::Method method = copier::copy_file_at(chunk.at_fd(), chunk.at_name(i).c_str(), dest.at_fd(),
+                                                             dest.at_name(chunk.names[i]).c_str(), copy_options);
                 copied_count++;
                 
-            } catch (const std::exception& e) {
                 if (cmd.verbose) {
-                    std::cerr << "Error copying " << file << ": " << e.what() << std::endl;
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << "  via " << copier::method_name(method) << std::endl;
                 }
-                result.errors.push_back("Failed to copy " + file.string() + ": " + e.what());
+                
+            } catch (const std::exception& e) {
+                copy_failed(file, e.what());
             }
+        };
+        
+        ChunkHandler copy_chunk = [&](const FileChunk& chunk) {
+            for (size_t i = 0; i < chunk.names.size(); ++i) {
+                copy_one(chunk, i);
+            }
+        };
+        
+        // With io_uring each executor task pushes its whole chunk through one ring.
+        // Delta updates have to read the destination, so they stay on copy_file_at.
+        if (cmd.use_io_uring && !cmd.delta && uring::available()) {
+            copy_chunk = [&, copy_each = copy_chunk](const FileChunk& chunk) {
+                uring::BatchCopier* ring = thread_copier(cmd.io_uring_depth);
+                if (!ring) {
+                    copy_each(chunk);
+                    return;
+                }
+                
+                std::vector<uring::CopyRequest> requests;
+                std::vector<size_t> picked;             // chunk index of each request
+                std::vector<struct stat> src_stats(chunk.names.size());
+                requests.reserve(chunk.names.size());
+                for (size_t i = 0; i < chunk.names.size(); ++i) {
+                    if (cmd.sync && !needs_copy(chunk, i, src_stats[i])) {
+                        skip_unchanged(chunk, i);
+                        continue;
+                    }
+                    picked.push_back(i);
+                    requests.push_back({chunk.at_name(i), dest.at_name(chunk.names[i]), chunk.at_fd(), dest.at_fd()});
+                    if (cmd.verbose) {
+                        std::lock_guard<std::mutex> lock(output_mutex);
+                        std::cerr << "Copying: " << chunk.path(i) << " → " << dest.path(chunk.names[i])
+                                  << " (io_uring)" << std::endl;
+                    }
+                }
+                
+                std::vector<int> errors = ring->copy(requests);
+                for (size_t r = 0; r < errors.size(); ++r) {
+                    size_t i = picked[r];
+                    if (errors[r] == 0 && cmd.sync) {
+                        // The ring copies data only; carry the times over like copy_file_at
+                        struct timespec times[2] = {src_stats[i].st_atim, src_stats[i].st_mtim};
+                        if (utimensat(dest.at_fd(), dest.at_name(chunk.names[i]).c_str(), times, 0) != 0) {
+                            errors[r] = errno;
+                        }
+                    }
+                    if (errors[r] == 0) {
+                        copied_count++;
+                        continue;
+                    }
+                    std::filesystem::filesystem_error error("cannot copy file", chunk.path(i), dest.path(chunk.names[i]),
+                                                            std::error_code(errors[r], std::generic_category()));
+                    copy_failed(chunk.path(i), error.what());
+                }
+            };
+        }
+        for_each_matching_file(cmd, source_path, dest_path, result, copy_chunk);
+        
+        if (cmd.dry_run) {
+            result.message = "Would copy " + std::to_string(result.files_matched) + " files";
+            result.success = true;
+            return result;
         }
         
-        result.files_affected = copied_count;
-        result.message = "Successfully copied " + std::to_string(copied_count) + " files";
+        result.files_affected = copied_count.load();
+        result.message = "Successfully copied " + std::to_string(copied_count.load()) + " files";
+        if (cmd.sync) {
+            result.message += ", " + std::to_string(unchanged_count.load()) + " unchanged";
+        }
         result.success = true;
         
     } catch (const std::exception& e) {
@@ -182,57 +709,324 @@ utils::FileOpResult delete_files(const Command& cmd) {
             return result;
         }
         
-        // Scan for matching files
-        std::vector<std::filesystem::path> files;
-        if (cmd.recursive) {
-            files = utils::scan_directory_recursive(source_path);
-        } else {
-            files = utils::scan_directory(source_path);
+        // Files are deleted on the executor as the scan streams them in: one
+        // batch of unlinks per chunk, relative to its already-open directory
+        std::atomic<int> deleted_count{0};
+        std::mutex output_mutex;   // guards result.errors and stderr
+        for_each_matching_file(cmd, source_path, {}, result, [&](const FileChunk& chunk) {
+            auto& batch = thread_metadata_batch(cmd.use_io_uring);
+            for (size_t i = 0; i < chunk.names.size(); ++i) {
+                if (cmd.verbose) {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << "Deleting: " << chunk.path(i) << std::endl;
+                }
+                batch.unlink(chunk.at_fd(), chunk.at_name(i));
+            }
+            
+            std::vector<int> errors = batch.run();
+            for (size_t i = 0; i < errors.size(); ++i) {
+                if (errors[i] == 0) {
+                    deleted_count++;
+                    continue;
+                }
+                std::string what = errno_error(errors[i], "cannot remove", chunk.path(i)).what();
+                std::lock_guard<std::mutex> lock(output_mutex);
+                if (cmd.verbose) {
+                    std::cerr << "Error deleting " << chunk.path(i) << ": " << what << std::endl;
+                }
+                result.errors.push_back("Failed to delete " + chunk.path(i).string() + ": " + what);
+            }
+        });
+        
+        if (cmd.dry_run) {
+            result.message = "Would delete " + std::to_string(result.files_matched) + " files";
+            result.success = true;
+            return result;
         }
         
-        // Filter files by pattern
-        std::vector<std::filesystem::path> matching_files;
-        for (const auto& file : files) {
-            if (utils::matches_pattern(file.filename().string(), cmd.pattern)) {
-                matching_files.push_back(file);
-            }
+        result.files_affected = deleted_count.load();
+        result.message = "Successfully deleted " + std::to_string(deleted_count.load()) + " files";
+        result.success = true;
+        
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_message = "Delete operation failed: " + std::string(e.what());
+    }
+    
+    result.end_time = std::chrono::high_resolution_clock::now();
+    return result;
+}
+
+utils::FileOpResult delete_tree(const Command& cmd) {
+    utils::FileOpResult result;
+    result.operation = "delete_tree";
+    result.start_time = std::chrono::high_resolution_clock::now();
+    
+    try {
+        std::filesystem::path source_path = utils::expand_path(cmd.source);
+        
+        // Safety checks
+        if (!utils::is_safe_directory(source_path)) {
+            result.success = false;
+            result.error_message = "Source directory is not safe to operate on";
+            return result;
         }
         
-        result.files_scanned = files.size();
-        result.files_matched = matching_files.size();
+        auto trees = find_matching_directories(cmd, source_path, result.files_scanned, result.errors);
+        result.files_matched = trees.size();
         
         if (cmd.dry_run) {
-            result.message = "Would delete " + std::to_string(matching_files.size()) + " files";
+            if (cmd.verbose) {
+                for (const auto& tree : trees) {
+                    std::cerr << "Would delete tree: " << tree << std::endl;
+                }
+            }
+            result.message = "Would delete " + std::to_string(trees.size()) + " directory trees";
             result.success = true;
             return result;
         }
         
-        // Delete files
-        int deleted_count = 0;
-        for (const auto& file : matching_files) {
-            try {
-                if (cmd.verbose) {
-                    std::cerr << "Deleting: " << file << std::endl;
+        if (cmd.verbose) {
+            for (const auto& tree : trees) {
+                std::cerr << "Deleting tree: " << tree << std::endl;
+            }
+        }
+        
+        auto removed = remover::remove_trees(trees, cmd.io_threads);
+        result.errors.insert(result.errors.end(), removed.errors.begin(), removed.errors.end());
+        if (cmd.verbose) {
+            for (const auto& error : removed.errors) {
+                std::cerr << error << std::endl;
+            }
+        }
+        
+        result.files_affected = removed.files + removed.directories;
+        result.message = "Successfully deleted " + std::to_string(trees.size()) + " directory trees (" +
+                         std::to_string(removed.files) + " files, " +
+                         std::to_string(removed.directories) + " directories)";
+        result.success = true;
+        
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_message = "Delete tree operation failed: " + std::string(e.what());
+    }
+    
+    result.end_time = std::chrono::high_resolution_clock::now();
+    return result;
+}
+
+utils::FileOpResult hash_files(const Command& cmd) {
+    utils::FileOpResult result;
+    result.operation = "hash";
+    result.start_time = std::chrono::high_resolution_clock::now();
+    
+    try {
+        std::filesystem::path source_path = utils::expand_path(cmd.source);
+        
+        // Small files spread over the executor a chunk at a time; large ones
+        // also split into leaves hashed by their own threads
+        hasher::HashOptions hash_options;
+        if (cmd.copy_workers > 0) hash_options.workers = cmd.copy_workers;
+        std::atomic<int> hashed_count{0};
+        std::mutex output_mutex;   // guards result.errors, result.digests and stderr
+        for_each_matching_file(cmd, source_path, {}, result, [&](const FileChunk& chunk) {
+            for (size_t i = 0; i < chunk.names.size(); ++i) {
+                try {
+                    uint64_t digest = hasher::hash_file_at(chunk.at_fd(), chunk.at_name(i).c_str(), hash_options);
+                    hashed_count++;
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    result.digests.emplace_back(chunk.path(i).string(), hasher::to_hex(digest));
+                    if (cmd.verbose) {
+                        std::cerr << result.digests.back().second << "  " << chunk.path(i) << std::endl;
+                    }
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    result.errors.push_back("Failed to hash " + chunk.path(i).string() + ": " + e.what());
                 }
-                
-                std::filesystem::remove(file);
-                deleted_count++;
-                
-            } catch (const std::exception& e) {
-                if (cmd.verbose) {
-                    std::cerr << "Error deleting " << file << ": " << e.what() << std::endl;
+            }
+        });
+        
+        if (cmd.dry_run) {
+            result.message = "Would hash " + std::to_string(result.files_matched) + " files";
+            result.success = true;
+            return result;
+        }
+        
+        std::sort(result.digests.begin(), result.digests.end());
+        result.files_affected = hashed_count.load();
+        result.message = "Hashed " + std::to_string(hashed_count.load()) + " files";
+        result.success = true;
+        
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_message = "Hash operation failed: " + std::string(e.what());
+    }
+    
+    result.end_time = std::chrono::high_resolution_clock::now();
+    return result;
+}
+
+utils::FileOpResult find_duplicates(const Command& cmd) {
+    utils::FileOpResult result;
+    result.operation = "find_duplicates";
+    result.start_time = std::chrono::high_resolution_clock::now();
+    
+    try {
+        std::filesystem::path source_path = utils::expand_path(cmd.source);
+        
+        duplicates::LinkMode mode = duplicates::LinkMode::Hardlink;
+        if (cmd.dedupe == "reflink") {
+            mode = duplicates::LinkMode::Reflink;
+        } else if (!cmd.dedupe.empty() && cmd.dedupe != "hardlink") {
+            result.success = false;
+            result.error_message = "Unknown dedupe mode: " + cmd.dedupe;
+            return result;
+        }
+        
+        // Safety checks
+        if (!cmd.dedupe.empty() && !utils::is_safe_directory(source_path)) {
+            result.success = false;
+            result.error_message = "Source directory is not safe to operate on";
+            return result;
+        }
+        
+        // Finding duplicates only reads, so a dry run still does it and just
+        // leaves the files alone
+        Command scan = cmd;
+        scan.dry_run = false;
+        std::vector<duplicates::File> files;
+        std::mutex files_mutex;    // guards files and result.errors
+        for_each_matching_file(scan, source_path, {}, result, [&](const FileChunk& chunk) {
+            // Candidates outlive the scan by the whole funnel, so they name
+            // their directory by path; holding its descriptor open for every
+            // directory with a match could run out of fds on a large tree
+            auto dir = std::make_shared<const scanner::Directory>(
+                scanner::Directory{chunk.dir->path, chunk.dir->rel, nullptr, nullptr, nullptr});
+            std::vector<duplicates::File> found;
+            for (size_t i = 0; i < chunk.names.size(); ++i) {
+                struct stat st;
+                if (fstatat(chunk.at_fd(), chunk.at_name(i).c_str(), &st, 0) != 0) {
+                    std::string what = errno_error(errno, "cannot stat", chunk.path(i)).what();
+                    std::lock_guard<std::mutex> lock(files_mutex);
+                    result.errors.push_back("Failed to read " + chunk.path(i).string() + ": " + what);
+                    continue;
                 }
-                result.errors.push_back("Failed to delete " + file.string() + ": " + e.what());
+                found.push_back({dir, chunk.names[i], static_cast<uint64_t>(st.st_size), st.st_dev, st.st_ino});
             }
+            std::lock_guard<std::mutex> lock(files_mutex);
+            std::move(found.begin(), found.end(), std::back_inserter(files));
+        });
+        
+        size_t threads = cmd.io_threads > 0 ? cmd.io_threads : executor::default_thread_count();
+        duplicates::FunnelStats stats;
+        auto groups = duplicates::find(std::move(files), threads, stats, result.errors);
+        if (cmd.verbose) {
+            std::cerr << "Partially hashed " << stats.partial_hashed << " files, fully hashed "
+                      << stats.fully_hashed << ", read " << utils::get_human_readable_size(stats.bytes_read)
+                      << std::endl;
         }
         
-        result.files_affected = deleted_count;
-        result.message = "Successfully deleted " + std::to_string(deleted_count) + " files";
+        size_t redundant = 0;
+        uint64_t reclaimable = 0;
+        for (const auto& group : groups) {
+            std::vector<std::string> paths;
+            for (const auto& file : group) paths.push_back(file.path().string());
+            result.duplicate_groups.push_back(std::move(paths));
+            redundant += group.size() - 1;
+            reclaimable += (group.size() - 1) * group.front().size;
+        }
+        
+        result.message = "Found " + std::to_string(groups.size()) + " groups of duplicates (" +
+                         std::to_string(redundant) + " redundant files, " +
+                         utils::get_human_readable_size(reclaimable) + ")";
+        result.files_affected = redundant;
+        
+        if (!cmd.dedupe.empty() && !cmd.dry_run) {
+            // Every copy after the first is linked to the first one
+            std::atomic<size_t> linked{0};
+            std::mutex errors_mutex;
+            executor::for_each_index(groups.size(), threads, [&](uint64_t g) {
+                const auto& group = groups[g];
+                for (size_t j = 1; j < group.size(); ++j) {
+                    int err = duplicates::link_duplicate(group[0], group[j], mode);
+                    if (err == 0) {
+                        linked++;
+                        continue;
+                    }
+                    std::string what = err == EBADE ? std::string("contents differ")
+                                                    : errno_error(err, "cannot link", group[j].path()).what();
+                    std::lock_guard<std::mutex> lock(errors_mutex);
+                    result.errors.push_back("Failed to " + cmd.dedupe + " " + group[j].path().string() +
+                                            " to " + group[0].path().string() + ": " + what);
+                }
+                return 0;
+            });
+            result.files_affected = linked.load();
+            result.message += ", replaced " + std::to_string(linked.load()) + " with " + cmd.dedupe + "s";
+        }
         result.success = true;
         
     } catch (const std::exception& e) {
         result.success = false;
-        result.error_message = "Delete operation failed: " + std::string(e.what());
+        result.error_message = "Find duplicates operation failed: " + std::string(e.what());
+    }
+    
+    result.end_time = std::chrono::high_resolution_clock::now();
+    return result;
+}
+
+utils::FileOpResult index_tree(const Command& cmd) {
+    utils::FileOpResult result;
+    result.operation = "index";
+    result.start_time = std::chrono::high_resolution_clock::now();
+    
+    try {
+        std::filesystem::path source_path = catalog::normalize(utils::expand_path(cmd.source));
+        if (!utils::validate_source_path(source_path)) {
+            result.success = false;
+            result.error_message = "Source directory does not exist: " + source_path.string();
+            return result;
+        }
+        
+        // Every directory is read again; nothing from an existing catalog is kept
+        catalog::Catalog index(source_path, catalog::location(source_path), false);
+        scanner::WalkOptions options;
+        options.threads = scanner::resolve_thread_count(cmd.threads);
+        options.cache = cmd.dry_run ? nullptr : &index;
+        
+        std::atomic<size_t> entries{0};
+        std::atomic<size_t> directories{0};
+        auto walk_errors = scanner::walk(source_path, options,
+            [&](size_t, int, const std::shared_ptr<const scanner::Directory>&,
+                std::span<const scanner::DirEntry> batch) {
+                entries += batch.size();
+                for (const auto& entry : batch) {
+                    if (entry.type == scanner::EntryType::Directory) directories++;
+                }
+            });
+        result.errors.insert(result.errors.end(), walk_errors.begin(), walk_errors.end());
+        result.files_scanned = entries.load();
+        
+        std::string counts = std::to_string(entries.load()) + " entries in " +
+                             std::to_string(directories.load() + 1) + " directories";
+        if (cmd.dry_run) {
+            result.message = "Would index " + counts + " under " + source_path.string();
+            result.success = true;
+            return result;
+        }
+        
+        if (int err = index.save(); err != 0) {
+            result.success = false;
+            result.error_message = "Failed to write index " + index.file().string() + ": " + std::strerror(err);
+            return result;
+        }
+        result.files_affected = entries.load();
+        result.message = "Indexed " + counts + " (" + index.file().string() + ")";
+        result.success = true;
+        
+    } catch (const std::exception& e) {
+        result.success = false;
+        result.error_message = "Index operation failed: " + std::string(e.what());
     }
     
     result.end_time = std::chrono::high_resolution_clock::now();
@@ -264,7 +1058,10 @@ utils::FileOpResult create_folder(const Command& cmd) {
             std::cerr << "Creating folder: " << folder_path << std::endl;
         }
         
-        std::filesystem::create_directories(folder_path);
+        int err = create_directories_batched(folder_path, cmd.use_io_uring);
+        if (err != 0) {
+            throw errno_error(err, "create_directories", folder_path);
+        }
         
         result.files_affected = 1;
         result.message = "Successfully created folder: " + folder_path.string();
@@ -279,6 +1076,10 @@ utils::FileOpResult create_folder(const Command& cmd) {
     return result;
 }
 
+void set_resources(Resources resources) {
+    shared_resources = std::move(resources);
+}
+
 utils::FileOpResult execute_command(const Command& cmd) {
     if (cmd.verbose) {
         std::cerr << "Executing command: " << command_to_string(cmd) << std::endl;
@@ -299,6 +1100,14 @@ utils::FileOpResult execute_command(const Command& cmd) {
         result = copy_files(cmd);
     } else if (cmd.action == "delete") {
         result = delete_files(cmd);
+    } else if (cmd.action == "delete_tree") {
+        result = delete_tree(cmd);
+    } else if (cmd.action == "hash") {
+        result = hash_files(cmd);
+    } else if (cmd.action == "find_duplicates") {
+        result = find_duplicates(cmd);
+    } else if (cmd.action == "index") {
+        result = index_tree(cmd);
     } else if (cmd.action == "create_folder") {
         result = create_folder(cmd);
     } else {
@@ -351,10 +1160,16 @@ bool validate_command(const Command& cmd) {
         return !cmd.source.empty() && !cmd.destination.empty();
     }
     
-    if (cmd.action == "delete") {
+    if (cmd.action == "delete" || cmd.action == "hash" || cmd.action == "find_duplicates" ||
+        cmd.action == "index") {
         return !cmd.source.empty();
     }
     
+    // An empty pattern would match every subdirectory
+    if (cmd.action == "delete_tree") {
+        return !cmd.source.empty() && !cmd.pattern.empty();
+    }
+    
     if (cmd.action == "create_folder") {
         return !cmd.destination.empty();
     }
@@ -2,26 +2,74 @@
 
 #include <string>
 #include <filesystem>
+#include <vector>
+#include <optional>
+#include <cstdint>
+#include <functional>
 #include "utils.hpp"
+#include "pattern.hpp"
+#include "metadata.hpp"
+#include "executor.hpp"
+#include "catalog.hpp"
 
 namespace actions {
 
 // Command structure received from Python frontend
 struct Command {
-    std::string action;           // "move", "copy", "delete", "create_folder"
-    std::string pattern;          // file pattern (".jpg", "*.png", "**/*.txt", etc.)
+    std::string action;           // "move", "copy", "delete", "delete_tree", "hash", "find_duplicates", "index", "create_folder"
+    std::string pattern;          // file pattern (".jpg", ".jpg,.png", "*.png", "**/*.txt", etc.)
     std::string source;           // source directory
     std::string destination;      // destination (for move/copy/create_folder)
     bool dry_run = false;         // preview mode
     bool force = false;           // skip confirmations
     bool recursive = false;       // scan subdirectories recursively
     bool verbose = false;         // detailed output
+    size_t threads = 0;           // scan worker threads (0 = hardware concurrency)
+    size_t io_threads = 0;        // file operation workers (0 = max(8, 2 x cores))
+    size_t device_limit = 0;      // parallel ops per fast device (0 = default, 32)
+    size_t slow_device_limit = 0; // parallel ops per rotational/removable device (0 = default, 2)
+    std::optional<uint64_t> large_file_threshold;   // copy files this large in parallel ranges (0 = never)
+    size_t copy_workers = 0;      // threads per large file copy (0 = default, 4)
+    bool verify = false;          // cross-device moves: compare the copy before unlinking
+    bool sync = false;            // copy: skip files whose destination copy is unchanged
+    bool checksum = false;        // sync: compare contents instead of size + mtime
+    bool delta = false;           // copy: rewrite only the changed blocks of existing files
+    std::string dedupe;           // find_duplicates: "" (report only), "hardlink" or "reflink"
+    bool use_io_uring = false;    // copy through io_uring when the kernel allows it
+    unsigned io_uring_depth = 0;  // I/Os in flight per ring (0 = default, 128)
+    std::vector<std::string> exclude;   // globs to skip ("node_modules", "build/", "*.tmp")
+    bool use_ignore_files = false;      // honor .gitignore/.smartfileignore while scanning
+    bool use_index = false;             // reuse and refresh the source's catalog (catalog.hpp)
+    utils::MetadataPredicates filters;  // size/age/owner/mode conditions
 };
 
+// State a long-running process keeps between commands (see server.hpp);
+// one-shot runs leave it empty and build everything per command
+struct Resources {
+    executor::ExecutorPool* executors = nullptr;
+    // The catalog an indexed command on source uses, or nullptr for one of its
+    // own. Shared catalogs are saved by their owner, not after each command.
+    std::function<catalog::Catalog*(const std::filesystem::path& source)> catalogs;
+    // Consult catalogs for every command, not only --index ones, so commands
+    // on the same tree share directory listings
+    bool share_listings = false;
+};
+
+// Not thread safe; call before commands start
+void set_resources(Resources resources);
+
 // File operation functions
 utils::FileOpResult move_files(const Command& cmd);
 utils::FileOpResult copy_files(const Command& cmd);
 utils::FileOpResult delete_files(const Command& cmd);
+// Removes whole directories matching the pattern, contents included
+utils::FileOpResult delete_tree(const Command& cmd);
+// Content digests (XXH64, tree hashed when large) of the matched files
+utils::FileOpResult hash_files(const Command& cmd);
+// Groups matched files with identical contents, optionally linking the copies
+utils::FileOpResult find_duplicates(const Command& cmd);
+// Rebuilds the catalog of the source tree from scratch
+utils::FileOpResult index_tree(const Command& cmd);
 utils::FileOpResult create_folder(const Command& cmd);
 
 // Main execution function
@@ -0,0 +1,646 @@
+#include "catalog.hpp"
+#include "hasher.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace catalog {
+
+namespace {
+
+constexpr char kMagic[8] = {'S', 'F', 'C', 'A', 'T', 'L', 'G', '1'};
+constexpr uint32_t kVersion = 2;
+
+// Listings this close to their directory's mtime may predate a change made in
+// the same timestamp tick
+constexpr int64_t kRacySeconds = 1;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t dir_count;
+    uint64_t entry_count;
+    uint64_t blob_size;
+    uint64_t root_offset;         // root path in the blob
+    uint64_t root_size;
+};
+
+struct DirRecord {
+    uint64_t path_offset;         // in the blob, NUL-terminated
+    uint64_t path_size;
+    uint64_t device;
+    uint64_t inode;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t scanned_at;           // when the listing was read, seconds
+    uint64_t first_entry;         // index into the entry columns
+    uint64_t entry_count;
+    uint64_t flags;
+    uint64_t extensions[4];       // Bloom filter of final extensions in the subtree
+};
+
+// Every directory below has a record, so extensions covers the whole subtree
+constexpr uint64_t kSubtreeComplete = 1;
+
+// Entry columns, in file order
+struct Columns {
+    const uint64_t* name_offset;  // in the blob, NUL-terminated
+    const uint64_t* size;
+    const int64_t* mtime;
+    const uint32_t* mode;
+    const uint32_t* uid;
+    const uint16_t* name_size;
+    const uint8_t* type;
+};
+
+constexpr uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t{7}; }
+
+// Byte offsets of each section for the given counts
+struct Layout {
+    uint64_t dirs, name_offset, size, mtime, mode, uid, name_size, type, blob, total;
+
+    Layout(uint64_t dir_count, uint64_t entry_count, uint64_t blob_size) {
+        dirs = sizeof(Header);
+        name_offset = dirs + dir_count * sizeof(DirRecord);
+        size = name_offset + entry_count * 8;
+        mtime = size + entry_count * 8;
+        mode = mtime + entry_count * 8;
+        uid = mode + entry_count * 4;
+        name_size = uid + entry_count * 4;
+        type = name_size + entry_count * 2;
+        blob = align8(type + entry_count);
+        total = blob + blob_size;
+    }
+};
+
+// Whether [offset, offset + size) lies within [0, limit), without overflowing
+bool fits(uint64_t offset, uint64_t size, uint64_t limit) {
+    return offset <= limit && size <= limit - offset;
+}
+
+int64_t now_seconds() {
+    return static_cast<int64_t>(std::time(nullptr));
+}
+
+// Whether a recorded listing still describes the directory stat found
+bool describes(const DirRecord& record, const struct stat& st) {
+    return record.device == static_cast<uint64_t>(st.st_dev) &&
+           record.inode == static_cast<uint64_t>(st.st_ino) &&
+           record.mtime_sec == st.st_mtim.tv_sec && record.mtime_nsec == st.st_mtim.tv_nsec &&
+           record.scanned_at > record.mtime_sec + kRacySeconds;
+}
+
+// 256-bit Bloom filter, two bits per extension: with the handful of
+// extensions a typical directory holds, a rare one is rejected almost always
+void bloom_add(uint64_t bloom[4], std::string_view extension) {
+    uint64_t h = hasher::xxh64(extension.data(), extension.size());
+    for (unsigned bit : {unsigned(h & 255), unsigned((h >> 8) & 255)}) {
+        bloom[bit / 64] |= uint64_t{1} << (bit % 64);
+    }
+}
+
+bool bloom_may_contain(const uint64_t bloom[4], std::string_view extension) {
+    uint64_t h = hasher::xxh64(extension.data(), extension.size());
+    for (unsigned bit : {unsigned(h & 255), unsigned((h >> 8) & 255)}) {
+        if (!(bloom[bit / 64] & (uint64_t{1} << (bit % 64)))) return false;
+    }
+    return true;
+}
+
+// Lowercased text after the last '.' of name, empty if there is none
+std::string_view final_extension(std::string_view name, std::string& buffer) {
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos) return {};
+    buffer.assign(name.substr(dot + 1));
+    for (char& c : buffer) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return buffer;
+}
+
+} // namespace
+
+// The catalog file as mapped at construction
+struct Catalog::Mapped {
+    void* base = MAP_FAILED;
+    size_t size = 0;
+    const Header* header = nullptr;
+    const DirRecord* dirs = nullptr;
+    Columns columns{};
+    const char* blob = nullptr;
+
+    ~Mapped() {
+        if (base != MAP_FAILED) munmap(base, size);
+    }
+
+    std::string_view path(const DirRecord& dir) const {
+        return {blob + dir.path_offset, dir.path_size};
+    }
+
+    // Binary search over the path-sorted directory records
+    const DirRecord* find(std::string_view dir) const {
+        const DirRecord* first = dirs;
+        const DirRecord* last = dirs + header->dir_count;
+        auto it = std::lower_bound(first, last, dir, [&](const DirRecord& record, std::string_view key) {
+            return path(record) < key;
+        });
+        return it != last && path(*it) == dir ? it : nullptr;
+    }
+};
+
+// A listing read from disk since the catalog was opened
+struct Catalog::Listing {
+    DirRecord info{};
+    std::string names;            // NUL-terminated names back to back
+    struct Entry {
+        uint64_t name_offset;     // into names
+        uint16_t name_size;
+        uint8_t type;
+        uint32_t mode;
+        uint32_t uid;
+        uint64_t size;
+        int64_t mtime;
+    };
+    std::vector<Entry> entries;
+    bool trusted = true;          // served without an mtime check while watched
+};
+
+// Stats the entries of a listing that the walk didn't (mode 0)
+void Catalog::fill_stats(const std::string& dir, Listing& listing) {
+    int dir_fd = -1;
+    for (auto& entry : listing.entries) {
+        if (entry.mode != 0) continue;
+        if (dir_fd < 0) dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (dir_fd < 0) return;
+        struct stat st;
+        if (fstatat(dir_fd, listing.names.data() + entry.name_offset, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        entry.mode = st.st_mode;
+        entry.uid = st.st_uid;
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtim.tv_sec;
+    }
+    if (dir_fd >= 0) close(dir_fd);
+}
+
+Catalog::Catalog(std::filesystem::path root, std::filesystem::path file, bool load)
+    : root_(std::move(root)), file_(std::move(file)) {
+    if (!load) return;
+
+    int fd = open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st;
+    auto mapped = std::make_unique<Mapped>();
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(Header)) {
+        mapped->size = st.st_size;
+        mapped->base = mmap(nullptr, mapped->size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapped->base == MAP_FAILED) return;
+
+    // Anything that doesn't add up is treated as no catalog at all
+    auto* base = static_cast<const char*>(mapped->base);
+    auto* header = reinterpret_cast<const Header*>(base);
+    if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion) return;
+    if (header->dir_count > mapped->size / sizeof(DirRecord) || header->entry_count > mapped->size / 8 ||
+        header->blob_size > mapped->size) {
+        return;
+    }
+    Layout layout(header->dir_count, header->entry_count, header->blob_size);
+    if (layout.total != mapped->size || !fits(header->root_offset, header->root_size, header->blob_size)) return;
+
+    mapped->header = header;
+    mapped->dirs = reinterpret_cast<const DirRecord*>(base + layout.dirs);
+    mapped->columns = {
+        reinterpret_cast<const uint64_t*>(base + layout.name_offset),
+        reinterpret_cast<const uint64_t*>(base + layout.size),
+        reinterpret_cast<const int64_t*>(base + layout.mtime),
+        reinterpret_cast<const uint32_t*>(base + layout.mode),
+        reinterpret_cast<const uint32_t*>(base + layout.uid),
+        reinterpret_cast<const uint16_t*>(base + layout.name_size),
+        reinterpret_cast<const uint8_t*>(base + layout.type),
+    };
+    mapped->blob = base + layout.blob;
+    if (std::string_view(mapped->blob + header->root_offset, header->root_size) != root_.native()) return;
+
+    // Every offset used later must stay inside the file, and every string
+    // handed to a system call must be NUL-terminated within the blob
+    auto terminated = [&](uint64_t offset, uint64_t size) {
+        return size < header->blob_size && fits(offset, size + 1, header->blob_size) &&
+               mapped->blob[offset + size] == '\0';
+    };
+    for (uint64_t d = 0; d < header->dir_count; ++d) {
+        const DirRecord& record = mapped->dirs[d];
+        if (!terminated(record.path_offset, record.path_size) ||
+            !fits(record.first_entry, record.entry_count, header->entry_count)) {
+            return;
+        }
+    }
+    for (uint64_t i = 0; i < header->entry_count; ++i) {
+        if (!terminated(mapped->columns.name_offset[i], mapped->columns.name_size[i])) return;
+    }
+    mapped_ = std::move(mapped);
+}
+
+Catalog::~Catalog() = default;
+
+bool Catalog::lookup(const std::filesystem::path& dir, const struct stat& dir_st,
+                     const std::function<void(std::span<scanner::DirEntry>)>& visit) {
+    // Names are copied out under the lock: visit may call back into the catalog
+    thread_local std::string names;
+    thread_local std::vector<scanner::DirEntry> batch;
+    batch.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A watched directory's listing is current by construction
+        bool watched = watched_.count(dir.native()) > 0;
+        auto fresh = fresh_.find(dir.native());
+        const DirRecord* record = nullptr;
+        if (fresh == fresh_.end() && mapped_ && !stale_.count(dir.native())) {
+            record = mapped_->find(dir.native());
+        }
+        if (fresh != fresh_.end() && ((watched && fresh->second->trusted) || describes(fresh->second->info, dir_st))) {
+            const Listing& listing = *fresh->second;
+            names = listing.names;
+            for (const auto& entry : listing.entries) {
+                batch.push_back({std::string_view(names.data() + entry.name_offset, entry.name_size),
+                                 static_cast<scanner::EntryType>(entry.type)});
+            }
+        } else if (record && (watched || describes(*record, dir_st))) {
+            const Columns& columns = mapped_->columns;
+            for (uint64_t i = record->first_entry; i < record->first_entry + record->entry_count; ++i) {
+                batch.push_back({std::string_view(mapped_->blob + columns.name_offset[i], columns.name_size[i]),
+                                 static_cast<scanner::EntryType>(columns.type[i])});
+            }
+        } else {
+            if (record) {
+                stale_.insert(dir.native());
+                changed_ = true;
+            }
+            misses_++;
+            return false;
+        }
+    }
+    hits_++;
+    if (!batch.empty()) visit(std::span<scanner::DirEntry>(batch));
+    return true;
+}
+
+bool Catalog::subtree_may_contain(const std::filesystem::path& dir, std::span<const std::string> extensions) {
+    const DirRecord* record = mapped_ ? mapped_->find(dir.native()) : nullptr;
+    if (!record || !(record->flags & kSubtreeComplete)) return true;
+    for (const auto& extension : extensions) {
+        if (bloom_may_contain(record->extensions, extension)) return true;
+    }
+
+    // The summary holds only while no directory in the subtree has changed.
+    // Re-read or outdated ones are known to have; watched ones are known not
+    // to; the rest take a stat each, not an open and a read.
+    std::vector<const DirRecord*> subtree{record};
+    std::string prefix = dir.native();
+    if (prefix.back() != '/') prefix.push_back('/');
+    const DirRecord* last = mapped_->dirs + mapped_->header->dir_count;
+    const DirRecord* it = std::lower_bound(record, last, prefix, [&](const DirRecord& entry, const std::string& key) {
+        return mapped_->path(entry) < key;
+    });
+    for (; it != last && mapped_->path(*it).starts_with(prefix); ++it) {
+        subtree.push_back(it);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string key;
+        for (auto& entry : subtree) {
+            key.assign(mapped_->path(*entry));
+            if (fresh_.count(key) || stale_.count(key)) return true;
+            if (watched_.count(key)) entry = nullptr;
+        }
+    }
+    for (const DirRecord* entry : subtree) {
+        struct stat st;
+        if (entry && !(lstat(mapped_->blob + entry->path_offset, &st) == 0 && describes(*entry, st))) return true;
+    }
+    pruned_++;
+    return false;
+}
+
+void Catalog::store(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+                    std::span<const scanner::DirEntry> batch) {
+    add(dir, dir_st, dir_fd, batch, false);
+}
+
+void Catalog::refresh(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+                      std::span<const scanner::DirEntry> batch) {
+    add(dir, dir_st, dir_fd, batch, true);
+}
+
+void Catalog::discard(const std::filesystem::path& dir, int dir_fd) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.erase(std::make_pair(dir.native(), dir_fd));
+}
+
+void Catalog::add(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+                  std::span<const scanner::DirEntry> batch, bool refreshed) {
+    // Stats the walk already took are kept; the rest are taken by save(), so
+    // listings that are only shared in memory cost no stat per entry
+    std::vector<Listing::Entry> entries;
+    std::string names;
+    entries.reserve(batch.size());
+    for (const auto& entry : batch) {
+        const struct stat* known = entry.stat;
+        entries.push_back({names.size(), static_cast<uint16_t>(entry.name.size()),
+                           static_cast<uint8_t>(entry.type),
+                           known ? static_cast<uint32_t>(known->st_mode) : 0u,
+                           known ? static_cast<uint32_t>(known->st_uid) : 0u,
+                           known ? static_cast<uint64_t>(known->st_size) : 0u,
+                           known ? static_cast<int64_t>(known->st_mtim.tv_sec) : 0});
+        names.append(entry.name);
+        names.push_back('\0');
+    }
+
+    // Reads in progress are told apart by their descriptor, which stays open
+    // until the last call
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto key = std::make_pair(dir.native(), dir_fd);
+    auto& listing = pending_[key];
+    if (!listing) {
+        listing = std::make_unique<Listing>();
+        listing->info.device = dir_st.st_dev;
+        listing->info.inode = dir_st.st_ino;
+        listing->info.mtime_sec = dir_st.st_mtim.tv_sec;
+        listing->info.mtime_nsec = dir_st.st_mtim.tv_nsec;
+        listing->info.scanned_at = now_seconds();
+    }
+    if (batch.empty()) {
+        // A read that started before the one already held may finish after it:
+        // an older listing never replaces a newer one, and one that can't be
+        // told apart by mtime, or lands while dir awaits a refresh, isn't
+        // trusted until checked against the directory
+        auto& held = fresh_[dir.native()];
+        const DirRecord& info = listing->info;
+        if (held && held->info.inode == info.inode &&
+            std::make_pair(held->info.mtime_sec, held->info.mtime_nsec) > std::make_pair(info.mtime_sec, info.mtime_nsec)) {
+            pending_.erase(key);
+            return;
+        }
+        bool tied = held && held->info.inode == info.inode &&
+                    held->info.mtime_sec == info.mtime_sec && held->info.mtime_nsec == info.mtime_nsec;
+        if (refreshed) {
+            invalidated_.erase(dir.native());
+        } else {
+            listing->trusted = !tied && !invalidated_.count(dir.native());
+        }
+        held = std::move(listing);
+        pending_.erase(key);
+        changed_ = true;
+        return;
+    }
+    for (auto& entry : entries) {
+        entry.name_offset += listing->names.size();
+        listing->entries.push_back(entry);
+    }
+    listing->names += names;
+}
+
+int Catalog::save() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!changed_ && mapped_) return 0;
+    for (auto& [path, listing] : fresh_) {
+        fill_stats(path, *listing);
+    }
+
+    // Every directory that goes into the new file, sorted by path: mapped
+    // listings still valid, plus complete fresh ones
+    struct Source {
+        std::string_view path;
+        const DirRecord* mapped = nullptr;
+        const Listing* fresh = nullptr;
+    };
+    std::vector<Source> sources;
+    if (mapped_) {
+        for (uint64_t i = 0; i < mapped_->header->dir_count; ++i) {
+            const DirRecord& record = mapped_->dirs[i];
+            std::string key(mapped_->path(record));
+            if (stale_.count(key) || fresh_.count(key)) continue;
+            sources.push_back({mapped_->path(record), &record, nullptr});
+        }
+    }
+    for (const auto& [path, listing] : fresh_) {
+        sources.push_back({path, nullptr, listing.get()});
+    }
+    std::sort(sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.path < b.path; });
+
+    // Blob: the root, then per directory its path and its names
+    uint64_t entry_count = 0;
+    uint64_t blob_size = root_.native().size() + 1;
+    std::vector<DirRecord> records;
+    records.reserve(sources.size());
+    for (const auto& source : sources) {
+        DirRecord record = source.mapped ? *source.mapped : source.fresh->info;
+        record.path_offset = blob_size;
+        record.path_size = source.path.size();
+        blob_size += source.path.size() + 1;
+        record.first_entry = entry_count;
+        record.entry_count = source.mapped ? source.mapped->entry_count : source.fresh->entries.size();
+        entry_count += record.entry_count;
+        blob_size += source.fresh ? source.fresh->names.size() : 0;
+        if (source.mapped) {
+            for (uint64_t i = 0; i < record.entry_count; ++i) {
+                blob_size += mapped_->columns.name_size[source.mapped->first_entry + i] + 1;
+            }
+        }
+        records.push_back(record);
+    }
+
+    // Extension summaries, children before parents: a path sorts after every
+    // prefix of it, so walking backwards reaches a directory's subtree first
+    std::unordered_map<std::string_view, size_t> by_path;
+    for (size_t d = 0; d < sources.size(); ++d) by_path.emplace(sources[d].path, d);
+    std::string extension_buffer;
+    std::string child;
+    for (size_t d = sources.size(); d-- > 0;) {
+        DirRecord& record = records[d];
+        record.flags = kSubtreeComplete;
+        std::memset(record.extensions, 0, sizeof(record.extensions));
+        for (uint64_t i = 0; i < record.entry_count; ++i) {
+            std::string_view name;
+            scanner::EntryType type;
+            if (sources[d].mapped) {
+                uint64_t e = sources[d].mapped->first_entry + i;
+                name = {mapped_->blob + mapped_->columns.name_offset[e], mapped_->columns.name_size[e]};
+                type = static_cast<scanner::EntryType>(mapped_->columns.type[e]);
+            } else {
+                const auto& entry = sources[d].fresh->entries[i];
+                name = {sources[d].fresh->names.data() + entry.name_offset, entry.name_size};
+                type = static_cast<scanner::EntryType>(entry.type);
+            }
+            if (type != scanner::EntryType::Directory) {
+                std::string_view extension = final_extension(name, extension_buffer);
+                if (!extension.empty()) bloom_add(record.extensions, extension);
+                continue;
+            }
+            child.assign(sources[d].path);
+            if (child.back() != '/') child.push_back('/');
+            child.append(name);
+            auto it = by_path.find(child);
+            if (it == by_path.end() || !(records[it->second].flags & kSubtreeComplete)) {
+                record.flags &= ~kSubtreeComplete;
+                continue;
+            }
+            for (int w = 0; w < 4; ++w) record.extensions[w] |= records[it->second].extensions[w];
+        }
+    }
+
+    std::filesystem::create_directories(file_.parent_path());
+    std::filesystem::path temp = file_;
+    temp += "." + std::to_string(getpid()) + ".tmp";
+    FILE* out = std::fopen(temp.c_str(), "wb");
+    if (!out) return errno;
+
+    Layout layout(records.size(), entry_count, blob_size);
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.dir_count = records.size();
+    header.entry_count = entry_count;
+    header.blob_size = blob_size;
+    header.root_offset = 0;
+    header.root_size = root_.native().size();
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::fwrite(records.data(), sizeof(DirRecord), records.size(), out);
+
+    // One pass over every entry per column; field(source, i) reads entry i of a
+    // source whichever side it comes from
+    auto write_column = [&](auto field) {
+        for (size_t d = 0; d < sources.size(); ++d) {
+            for (uint64_t i = 0; i < records[d].entry_count; ++i) {
+                auto value = field(d, i);
+                std::fwrite(&value, sizeof(value), 1, out);
+            }
+        }
+    };
+    auto mapped_index = [&](size_t d, uint64_t i) { return sources[d].mapped->first_entry + i; };
+
+    // Names follow their directory's path in the blob, in entry order
+    uint64_t name_offset = 0;
+    size_t current = SIZE_MAX;
+    write_column([&](size_t d, uint64_t i) -> uint64_t {
+        if (d != current) {
+            current = d;
+            name_offset = records[d].path_offset + records[d].path_size + 1;
+        }
+        uint64_t offset = name_offset;
+        name_offset += (sources[d].mapped ? mapped_->columns.name_size[mapped_index(d, i)]
+                                          : sources[d].fresh->entries[i].name_size) + 1;
+        return offset;
+    });
+    write_column([&](size_t d, uint64_t i) -> uint64_t {
+        return sources[d].mapped ? mapped_->columns.size[mapped_index(d, i)] : sources[d].fresh->entries[i].size;
+    });
+    write_column([&](size_t d, uint64_t i) -> int64_t {
+        return sources[d].mapped ? mapped_->columns.mtime[mapped_index(d, i)] : sources[d].fresh->entries[i].mtime;
+    });
+    write_column([&](size_t d, uint64_t i) -> uint32_t {
+        return sources[d].mapped ? mapped_->columns.mode[mapped_index(d, i)] : sources[d].fresh->entries[i].mode;
+    });
+    write_column([&](size_t d, uint64_t i) -> uint32_t {
+        return sources[d].mapped ? mapped_->columns.uid[mapped_index(d, i)] : sources[d].fresh->entries[i].uid;
+    });
+    write_column([&](size_t d, uint64_t i) -> uint16_t {
+        return sources[d].mapped ? mapped_->columns.name_size[mapped_index(d, i)]
+                                 : sources[d].fresh->entries[i].name_size;
+    });
+    write_column([&](size_t d, uint64_t i) -> uint8_t {
+        return sources[d].mapped ? mapped_->columns.type[mapped_index(d, i)] : sources[d].fresh->entries[i].type;
+    });
+    static const char kPadding[8] = {};
+    std::fwrite(kPadding, 1, layout.blob - (layout.type + entry_count), out);
+
+    std::fwrite(root_.c_str(), 1, root_.native().size() + 1, out);
+    for (size_t d = 0; d < sources.size(); ++d) {
+        std::fwrite(sources[d].path.data(), 1, sources[d].path.size(), out);
+        std::fputc('\0', out);
+        if (sources[d].fresh) {
+            std::fwrite(sources[d].fresh->names.data(), 1, sources[d].fresh->names.size(), out);
+            continue;
+        }
+        for (uint64_t i = 0; i < records[d].entry_count; ++i) {
+            uint64_t e = mapped_index(d, i);
+            std::fwrite(mapped_->blob + mapped_->columns.name_offset[e], 1, mapped_->columns.name_size[e] + 1, out);
+        }
+    }
+
+    int err = std::ferror(out) ? EIO : 0;
+    if (std::fclose(out) != 0 && err == 0) err = errno;
+    if (err == 0 && std::rename(temp.c_str(), file_.c_str()) != 0) err = errno;
+    if (err != 0) std::remove(temp.c_str());
+    if (err == 0) changed_ = false;
+    return err;
+}
+
+bool Catalog::current(const std::filesystem::path& dir, const struct stat& dir_st) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto fresh = fresh_.find(dir.native()); fresh != fresh_.end()) {
+        return describes(fresh->second->info, dir_st);
+    }
+    const DirRecord* record = mapped_ && !stale_.count(dir.native()) ? mapped_->find(dir.native()) : nullptr;
+    return record && describes(*record, dir_st);
+}
+
+void Catalog::watch(const std::filesystem::path& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watched_.insert(dir.native());
+}
+
+void Catalog::unwatch(const std::filesystem::path& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    watched_.erase(dir.native());
+    invalidated_.erase(dir.native());
+}
+
+void Catalog::invalidate(const std::filesystem::path& dir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fresh_.erase(dir.native());
+    invalidated_.insert(dir.native());
+    if (mapped_ && mapped_->find(dir.native())) stale_.insert(dir.native());
+    changed_ = true;
+}
+
+std::filesystem::path location(const std::filesystem::path& root) {
+    std::filesystem::path base;
+    if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+        base = cache;
+    } else if (const char* home = std::getenv("HOME")) {
+        base = std::filesystem::path(home) / ".cache";
+    } else {
+        base = std::filesystem::temp_directory_path();
+    }
+    const std::string& key = root.native();
+    return base / "smartfilecmd" / ("catalog-" + hasher::to_hex(hasher::xxh64(key.data(), key.size())) + ".idx");
+}
+
+std::filesystem::path normalize(const std::filesystem::path& path) {
+    auto normal = std::filesystem::absolute(path).lexically_normal();
+    if (!normal.has_filename() && normal != normal.root_path()) normal = normal.parent_path();
+    return normal;
+}
+
+std::unique_ptr<Catalog> open_for(const std::filesystem::path& path) {
+    auto root = normalize(path);
+    for (auto dir = root;; dir = dir.parent_path()) {
+        auto file = location(dir);
+        if (access(file.c_str(), R_OK) == 0) {
+            return std::make_unique<Catalog>(dir, file);
+        }
+        if (dir == dir.root_path()) break;
+    }
+    return std::make_unique<Catalog>(root, location(root));
+}
+
+} // namespace catalog
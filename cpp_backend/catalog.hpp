@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "scanner.hpp"
+
+namespace catalog {
+
+// Persistent index of scanned directory trees: one file per indexed root,
+// mapped read-only and laid out in columns (directory records sorted by path,
+// then one array per entry field, then a string blob), so a lookup is a binary
+// search plus pointer arithmetic. Opening only checks that every offset stays
+// within the file.
+//
+// A directory's listing is reused while its inode and mtime are unchanged; the
+// mtime moves whenever an entry is created, removed or renamed. Listings
+// recorded within a second of the directory's mtime are not trusted (the
+// timestamp may be too coarse to show a later change). Entry sizes and mtimes
+// are as of the save after their directory was read: writes inside a file
+// don't touch the directory, so the walker hands out names and types only.
+// Listings read since the catalog was opened are reused the same way, so a
+// long-lived process reads a directory again only after it changed.
+//
+// Each directory also carries a Bloom filter of the final extensions found in
+// its whole subtree, which lets an extension query skip branches that can't
+// hold a match.
+class Catalog : public scanner::ListingCache {
+public:
+    // Uses the catalog stored in file if it is a valid one for root (and load
+    // is set), otherwise starts empty. root must be absolute and normalized,
+    // like the paths the walker will look up.
+    Catalog(std::filesystem::path root, std::filesystem::path file, bool load = true);
+    ~Catalog() override;
+
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+
+    bool lookup(const std::filesystem::path& dir, const struct stat& dir_st,
+                const std::function<void(std::span<scanner::DirEntry>)>& visit) override;
+    void store(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+               std::span<const scanner::DirEntry> batch) override;
+
+    void discard(const std::filesystem::path& dir, int dir_fd) override;
+
+    // store() for a watcher reading dir again after an event: the listing is
+    // current and trusted while dir is watched
+    void refresh(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+                 std::span<const scanner::DirEntry> batch);
+
+    // False if the subtree's summary rules out every extension and no
+    // directory in it changed since it was recorded (one lstat each)
+    bool subtree_may_contain(const std::filesystem::path& dir,
+                             std::span<const std::string> extensions) override;
+
+    // Whether the listing held for dir (if any) still matches its stat
+    bool current(const std::filesystem::path& dir, const struct stat& dir_st);
+
+    // A watcher keeps dir's listing current from here on (watcher.hpp), so it
+    // is served without comparing mtimes, and summaries covering it are
+    // trusted without a stat; unwatch() ends that
+    void watch(const std::filesystem::path& dir);
+    void unwatch(const std::filesystem::path& dir);
+
+    // Drops dir's listing; the next walk reads it from disk. Until refresh()
+    // completes, listings walks store for dir are validated by mtime even
+    // while it is watched: their reads may predate the change.
+    void invalidate(const std::filesystem::path& dir);
+
+    // Writes the reused listings plus the ones read since to file (through a
+    // temporary and a rename) if anything changed. Directories that were
+    // deleted stay in the file, unused, until it is rebuilt from scratch.
+    // Returns 0 or an errno value.
+    int save();
+
+    const std::filesystem::path& root() const { return root_; }
+    const std::filesystem::path& file() const { return file_; }
+
+    size_t hits() const { return hits_.load(); }
+    size_t misses() const { return misses_.load(); }
+    size_t pruned() const { return pruned_.load(); }
+
+private:
+    struct Mapped;
+    struct Listing;
+
+    void add(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+             std::span<const scanner::DirEntry> batch, bool refreshed);
+    static void fill_stats(const std::string& dir, Listing& listing);
+
+    std::filesystem::path root_;
+    std::filesystem::path file_;
+    std::unique_ptr<Mapped> mapped_;
+
+    std::mutex mutex_;                                   // guards the members below
+    std::unordered_map<std::string, std::unique_ptr<Listing>> fresh_;
+    std::map<std::pair<std::string, int>, std::unique_ptr<Listing>> pending_;   // reads in progress
+    std::unordered_set<std::string> stale_;              // mapped listings found outdated
+    std::unordered_set<std::string> watched_;
+    std::unordered_set<std::string> invalidated_;        // awaiting refresh()
+    bool changed_ = false;                               // since the last save
+
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<size_t> pruned_{0};
+};
+
+// Where the catalog for root lives: $XDG_CACHE_HOME/smartfilecmd (or
+// ~/.cache/smartfilecmd), named after a hash of the root path
+std::filesystem::path location(const std::filesystem::path& root);
+
+// Absolute, normalized form of path without a trailing separator
+std::filesystem::path normalize(const std::filesystem::path& path);
+
+// The catalog of the closest indexed directory at or above path, or a new
+// empty one rooted at path if there is none
+std::unique_ptr<Catalog> open_for(const std::filesystem::path& path);
+
+} // namespace catalog
@@ -0,0 +1,514 @@
+#include "copier.hpp"
+#include "executor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace copier {
+
+namespace {
+
+constexpr size_t kBufferSize = 1 << 20;
+constexpr size_t kChunkSize = 1 << 30;    // per copy_file_range/sendfile call
+
+// Methods known not to work between a pair of devices
+class CapabilityCache {
+public:
+    bool unsupported(dev_t src, dev_t dst, Method method) const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = failed_.find({src, dst});
+        return it != failed_.end() && (it->second & bit(method));
+    }
+
+    void mark_unsupported(dev_t src, dev_t dst, Method method) {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        failed_[{src, dst}] |= bit(method);
+    }
+
+private:
+    static unsigned bit(Method method) { return 1u << static_cast<unsigned>(method); }
+
+    mutable std::shared_mutex mutex_;
+    std::map<std::pair<dev_t, dev_t>, unsigned> failed_;
+};
+
+CapabilityCache& capabilities() {
+    static CapabilityCache cache;
+    return cache;
+}
+
+// Errors meaning "this method can't do this copy" rather than a real I/O failure
+bool is_unsupported(int err) {
+    return err == EOPNOTSUPP || err == ENOTSUP || err == ENOSYS || err == EXDEV ||
+           err == EINVAL || err == ENOTTY || err == EBADF;
+}
+
+// errno after a call that returned -1, EIO should it have left errno unset
+int failure_errno() {
+    return errno != 0 ? errno : EIO;
+}
+
+// Copies from offset until end or EOF
+int read_write_loop(int src_fd, int dst_fd, uint64_t offset, uint64_t end = UINT64_MAX) {
+    thread_local std::vector<char> buffer(kBufferSize);
+    while (offset < end) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), end - offset));
+        ssize_t n = pread(src_fd, buffer.data(), want, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return 0;
+
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = pwrite(dst_fd, buffer.data() + done, n - done, offset + done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += w;
+        }
+        offset += n;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+
+// Kernel-side copy loop shared by copy_file_range and sendfile. Advances offset;
+// returns 0 when size bytes are copied or the source hit EOF early.
+template <typename CopyChunk>
+int kernel_copy(uint64_t& offset, uint64_t size, CopyChunk copy_chunk) {
+    while (offset < size) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(size - offset, kChunkSize));
+        ssize_t n = copy_chunk(offset, want);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        offset += n;
+    }
+    return 0;
+}
+
+#endif
+
+// Copies [begin, end) at the same offsets in dst. Clears use_kernel once
+// copy_file_range turns out to be unsupported for this pair of files.
+int copy_range(int src_fd, int dst_fd, uint64_t begin, uint64_t end, std::atomic<bool>& use_kernel) {
+#ifdef __linux__
+    if (use_kernel.load(std::memory_order_relaxed)) {
+        uint64_t offset = begin;
+        int rc = kernel_copy(offset, end, [&](uint64_t pos, size_t want) {
+            loff_t in = pos;
+            loff_t out = pos;
+            return copy_file_range(src_fd, &in, dst_fd, &out, want, 0);
+        });
+        if (rc == 0) return 0;
+        if (!is_unsupported(errno)) return -1;
+        use_kernel.store(false, std::memory_order_relaxed);
+        begin = offset;
+    }
+#else
+    (void)use_kernel;
+#endif
+    return read_write_loop(src_fd, dst_fd, begin, end);
+}
+
+// Reads exactly want bytes at offset unless EOF comes first; returns the count or -1
+ssize_t pread_full(int fd, char* buffer, size_t want, uint64_t offset) {
+    size_t done = 0;
+    while (done < want) {
+        ssize_t n = pread(fd, buffer + done, want - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+}
+
+// Delta update of [begin, end): blocks the destination (dst_size bytes long)
+// already holds unchanged are left alone, the rest are written over
+int update_range(int src_fd, int dst_fd, uint64_t begin, uint64_t end, uint64_t dst_size, size_t block) {
+    thread_local std::vector<char> src_buffer;
+    thread_local std::vector<char> dst_buffer;
+    src_buffer.resize(block);
+    dst_buffer.resize(block);
+
+    for (uint64_t offset = begin; offset < end; offset += block) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(block, end - offset));
+        ssize_t n = pread_full(src_fd, src_buffer.data(), want, offset);
+        if (n < 0) return -1;
+        if (n == 0) return 0;     // the source shrank; the caller truncates
+
+        if (offset + n <= dst_size) {
+            ssize_t d = pread_full(dst_fd, dst_buffer.data(), n, offset);
+            if (d < 0) return -1;
+            if (d == n && std::memcmp(src_buffer.data(), dst_buffer.data(), n) == 0) continue;
+        }
+
+        for (ssize_t done = 0; done < n;) {
+            ssize_t w = pwrite(dst_fd, src_buffer.data() + done, n - done, offset + done);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                return -1;
+            }
+            done += w;
+        }
+    }
+    return 0;
+}
+
+// Opens dst for an in-place delta update. Returns 0, ENOENT-like errors (the
+// caller then does a regular copy) or another errno value.
+int open_for_update_at(int src_dir, const char* src_name, int dst_dir, const char* dst_name,
+                       int& src_fd, int& dst_fd, struct stat& src_st, struct stat& dst_st) {
+    src_fd = openat(src_dir, src_name, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) return errno;
+    dst_fd = openat(dst_dir, dst_name, O_RDWR | O_CLOEXEC);
+    if (dst_fd < 0) {
+        int err = errno;
+        close(src_fd);
+        return err;
+    }
+
+    int err = 0;
+    if (fstat(src_fd, &src_st) != 0 || fstat(dst_fd, &dst_st) != 0) {
+        err = errno;
+    } else if (!S_ISREG(src_st.st_mode)) {
+        err = EINVAL;
+    } else if (dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino) {
+        err = EEXIST;
+    } else if (!S_ISREG(dst_st.st_mode) || dst_st.st_size == 0) {
+        err = ENOENT;             // nothing worth keeping
+    }
+    if (err != 0) {
+        close(src_fd);
+        close(dst_fd);
+    }
+    return err;
+}
+
+// Delta path of copy_file_at. Ranges of the file are compared by several
+// threads like copy_data_parallel; a smaller source truncates the destination.
+int update_data(int src_fd, int dst_fd, uint64_t size, uint64_t dst_size, const CopyOptions& options) {
+#ifdef __linux__
+    posix_fadvise(src_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(dst_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    size_t block = static_cast<size_t>(std::clamp<uint64_t>(options.delta_block_size, 4096, kBufferSize));
+    uint64_t range_size = std::max<uint64_t>(options.range_size, block);
+    range_size -= range_size % block;
+    uint64_t ranges = (size + range_size - 1) / range_size;
+    size_t workers = options.parallel_threshold > 0 && size >= options.parallel_threshold ? options.workers : 1;
+
+    int err = executor::for_each_index(ranges, workers, [&](uint64_t index) {
+        uint64_t begin = index * range_size;
+        return update_range(src_fd, dst_fd, begin, std::min(size, begin + range_size), dst_size, block) == 0
+                   ? 0 : failure_errno();
+    });
+    if (err != 0) {
+        errno = err;
+        return -1;
+    }
+
+    // Cut off whatever the old destination had past the source's current end,
+    // and append what the source grew by meanwhile
+    struct stat st;
+    if (fstat(src_fd, &st) != 0) return -1;
+    uint64_t now = st.st_size;
+    if (dst_size > now && ftruncate(dst_fd, now) != 0) return -1;
+    return now > size ? read_write_loop(src_fd, dst_fd, size) : 0;
+}
+
+// Large-file path of copy_data: reflink if possible, otherwise preallocate the
+// destination and let several threads copy fixed-size ranges
+int copy_data_parallel(int src_fd, int dst_fd, uint64_t size, dev_t src_dev, dev_t dst_dev,
+                       const CopyOptions& options, Method& used) {
+    auto& cache = capabilities();
+
+#ifdef __linux__
+    if (!cache.unsupported(src_dev, dst_dev, Method::Reflink)) {
+        if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+            used = Method::Reflink;
+            return 0;
+        }
+        if (!is_unsupported(errno)) return -1;
+        cache.mark_unsupported(src_dev, dst_dev, Method::Reflink);
+    }
+
+    // Reserve the extents in one go: no fragmentation from out-of-order writers,
+    // and ENOSPC shows up before any data is copied
+    if (fallocate(dst_fd, 0, 0, size) != 0 && !is_unsupported(errno)) return -1;
+#endif
+
+    uint64_t range_size = std::max<uint64_t>(options.range_size, kBufferSize);
+    uint64_t ranges = (size + range_size - 1) / range_size;
+
+    std::atomic<bool> use_kernel{!cache.unsupported(src_dev, dst_dev, Method::CopyFileRange)};
+    bool kernel_at_start = use_kernel.load();
+    int error = executor::for_each_index(ranges, options.workers, [&](uint64_t index) {
+        uint64_t begin = index * range_size;
+        return copy_range(src_fd, dst_fd, begin, std::min(size, begin + range_size), use_kernel) == 0
+                   ? 0 : failure_errno();
+    });
+
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    if (kernel_at_start && !use_kernel) {
+        cache.mark_unsupported(src_dev, dst_dev, Method::CopyFileRange);
+    }
+    used = use_kernel ? Method::CopyFileRange : Method::ReadWrite;
+
+    // The source may have changed size since it was stat'ed: drop preallocated
+    // space it no longer fills, or append what it grew by
+    struct stat st;
+    if (fstat(src_fd, &st) != 0) return -1;
+    if (static_cast<uint64_t>(st.st_size) < size) {
+        return ftruncate(dst_fd, st.st_size);
+    }
+    return read_write_loop(src_fd, dst_fd, size);
+}
+
+} // namespace
+
+const char* method_name(Method method) {
+    switch (method) {
+        case Method::Reflink: return "reflink";
+        case Method::CopyFileRange: return "copy_file_range";
+        case Method::Sendfile: return "sendfile";
+        case Method::ReadWrite: return "read/write";
+        case Method::Delta: return "delta";
+    }
+    return "unknown";
+}
+
+int copy_data(int src_fd, int dst_fd, uint64_t size, dev_t src_dev, dev_t dst_dev, Method& used) {
+    auto& cache = capabilities();
+    uint64_t offset = 0;
+
+    // Empty (or pseudo-filesystem) files: just read until EOF
+    if (size == 0) {
+        used = Method::ReadWrite;
+        return read_write_loop(src_fd, dst_fd, 0);
+    }
+
+#ifdef __linux__
+    if (!cache.unsupported(src_dev, dst_dev, Method::Reflink)) {
+        if (ioctl(dst_fd, FICLONE, src_fd) == 0) {
+            used = Method::Reflink;
+            return 0;
+        }
+        if (!is_unsupported(errno)) return -1;
+        cache.mark_unsupported(src_dev, dst_dev, Method::Reflink);
+    }
+
+    if (!cache.unsupported(src_dev, dst_dev, Method::CopyFileRange)) {
+        int rc = kernel_copy(offset, size, [&](uint64_t pos, size_t want) {
+            loff_t in = pos;
+            loff_t out = pos;
+            return copy_file_range(src_fd, &in, dst_fd, &out, want, 0);
+        });
+        if (rc == 0 && offset >= size) {
+            used = Method::CopyFileRange;
+            return 0;
+        }
+        if (rc != 0 && !is_unsupported(errno)) return -1;
+        if (offset == 0 && rc != 0) cache.mark_unsupported(src_dev, dst_dev, Method::CopyFileRange);
+    }
+
+    if (!cache.unsupported(src_dev, dst_dev, Method::Sendfile)) {
+        if (lseek(dst_fd, offset, SEEK_SET) < 0) return -1;
+        uint64_t start = offset;
+        int rc = kernel_copy(offset, size, [&](uint64_t pos, size_t want) {
+            off_t in = pos;
+            return sendfile(dst_fd, src_fd, &in, want);
+        });
+        if (rc == 0 && offset >= size) {
+            used = Method::Sendfile;
+            return 0;
+        }
+        if (rc != 0 && !is_unsupported(errno)) return -1;
+        if (offset == start && rc != 0) cache.mark_unsupported(src_dev, dst_dev, Method::Sendfile);
+    }
+#else
+    (void)cache;
+    (void)src_dev;
+    (void)dst_dev;
+#endif
+
+    // Also finishes a kernel copy that stopped short because the file shrank
+    used = Method::ReadWrite;
+    return read_write_loop(src_fd, dst_fd, offset);
+}
+
+int open_for_copy(const std::filesystem::path& src, const std::filesystem::path& dst,
+                  int& src_fd, int& dst_fd, struct stat& src_st, struct stat& dst_st) {
+    return open_for_copy_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), src_fd, dst_fd, src_st, dst_st);
+}
+
+int open_for_copy_at(int src_dir, const char* src_name, int dst_dir, const char* dst_name,
+                     int& src_fd, int& dst_fd, struct stat& src_st, struct stat& dst_st) {
+    src_fd = openat(src_dir, src_name, O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) return errno;
+
+    int err = 0;
+    if (fstat(src_fd, &src_st) != 0) {
+        err = errno;
+    } else if (!S_ISREG(src_st.st_mode)) {
+        err = EINVAL;
+    }
+    if (err != 0) {
+        close(src_fd);
+        return err;
+    }
+
+    dst_fd = openat(dst_dir, dst_name, O_WRONLY | O_CREAT | O_CLOEXEC, src_st.st_mode & 07777);
+    if (dst_fd < 0) {
+        err = errno;
+        close(src_fd);
+        return err;
+    }
+
+    // Refuse to truncate the source when both names point at the same file
+    if (fstat(dst_fd, &dst_st) != 0) {
+        err = errno;
+    } else if (dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino) {
+        err = EEXIST;
+    } else if (ftruncate(dst_fd, 0) != 0 || fchmod(dst_fd, src_st.st_mode & 07777) != 0) {
+        err = errno;
+    }
+    if (err != 0) {
+        close(src_fd);
+        close(dst_fd);
+    }
+    return err;
+}
+
+Method copy_file(const std::filesystem::path& src, const std::filesystem::path& dst,
+                 const CopyOptions& options) {
+    return copy_file_at(AT_FDCWD, src.c_str(), AT_FDCWD, dst.c_str(), options);
+}
+
+Method copy_file_at(int src_dir, const char* src_name, int dst_dir, const char* dst_name,
+                    const CopyOptions& options) {
+    auto fail = [&](int err) -> Method {
+        throw std::filesystem::filesystem_error("cannot copy file", src_name, dst_name,
+                                                std::error_code(err, std::generic_category()));
+    };
+
+    int src_fd;
+    int dst_fd;
+    struct stat src_st;
+    struct stat dst_st;
+    int err = ENOENT;
+    bool update = false;
+    if (options.delta) {
+        err = open_for_update_at(src_dir, src_name, dst_dir, dst_name, src_fd, dst_fd, src_st, dst_st);
+        update = err == 0;
+        if (err != 0 && err != ENOENT && err != EACCES) return fail(err);
+    }
+    if (!update) {
+        err = open_for_copy_at(src_dir, src_name, dst_dir, dst_name, src_fd, dst_fd, src_st, dst_st);
+        if (err != 0) return fail(err);
+    }
+
+    Method used = Method::ReadWrite;
+    uint64_t size = src_st.st_size;
+    bool split = options.parallel_threshold > 0 && size >= options.parallel_threshold &&
+                 options.workers > 1;
+    int rc;
+    if (update) {
+        used = Method::Delta;
+        rc = update_data(src_fd, dst_fd, size, dst_st.st_size, options);
+        if (rc == 0 && fchmod(dst_fd, src_st.st_mode & 07777) != 0) rc = -1;
+    } else {
+        rc = split ? copy_data_parallel(src_fd, dst_fd, size, src_st.st_dev, dst_st.st_dev, options, used)
+                   : copy_data(src_fd, dst_fd, size, src_st.st_dev, dst_st.st_dev, used);
+    }
+    if (rc != 0) err = errno;
+
+    if (err == 0 && options.preserve_times) {
+        struct timespec times[2] = {src_st.st_atim, src_st.st_mtim};
+        if (futimens(dst_fd, times) != 0) err = errno;
+    }
+
+    close(src_fd);
+    if (close(dst_fd) != 0 && err == 0) {
+        err = errno;
+    }
+    if (err != 0) return fail(err);
+    return used;
+}
+
+bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b) {
+    auto fail = [&](int err) -> bool {
+        throw std::filesystem::filesystem_error("cannot compare files", a, b,
+                                                std::error_code(err, std::generic_category()));
+    };
+
+    int a_fd = open(a.c_str(), O_RDONLY | O_CLOEXEC);
+    if (a_fd < 0) return fail(errno);
+    int b_fd = open(b.c_str(), O_RDONLY | O_CLOEXEC);
+    if (b_fd < 0) {
+        int err = errno;
+        close(a_fd);
+        return fail(err);
+    }
+
+    struct stat a_st;
+    struct stat b_st;
+    int err = 0;
+    bool same = false;
+    if (fstat(a_fd, &a_st) != 0 || fstat(b_fd, &b_st) != 0) {
+        err = errno;
+    } else if (a_st.st_size == b_st.st_size) {
+#ifdef __linux__
+        posix_fadvise(a_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise(b_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        thread_local std::vector<char> a_buffer(kBufferSize);
+        thread_local std::vector<char> b_buffer(kBufferSize);
+        same = true;
+        for (off_t offset = 0; same && offset < a_st.st_size;) {
+            ssize_t a_n = pread(a_fd, a_buffer.data(), a_buffer.size(), offset);
+            ssize_t b_n = a_n > 0 ? pread(b_fd, b_buffer.data(), a_n, offset) : a_n;
+            if (a_n < 0 || b_n < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                break;
+            }
+            same = a_n == b_n && a_n > 0 && std::memcmp(a_buffer.data(), b_buffer.data(), a_n) == 0;
+            offset += a_n;
+        }
+    }
+
+    close(a_fd);
+    close(b_fd);
+    if (err != 0) return fail(err);
+    return same;
+}
+
+} // namespace copier
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+namespace copier {
+
+// How a file's data ended up being copied, fastest first
+enum class Method {
+    Reflink,          // FICLONE: shares extents, no data copied (btrfs, XFS, ...)
+    CopyFileRange,    // in-kernel copy, may be offloaded by the filesystem
+    Sendfile,         // in-kernel copy through the page cache
+    ReadWrite,        // userspace buffered loop
+    Delta             // existing destination updated in place, changed blocks only
+};
+
+const char* method_name(Method method);
+
+// Large files are split into ranges that several threads copy at once, which
+// keeps more requests in flight on fast storage than a single sequential loop
+struct CopyOptions {
+    uint64_t parallel_threshold = uint64_t{1} << 30;   // split files at least this large (0 = never)
+    size_t workers = 4;                               // threads per large file
+    uint64_t range_size = uint64_t{64} << 20;         // bytes per work item
+    bool preserve_times = false;                      // carry over atime/mtime, as mv does
+
+    // Update an existing destination in place: compare it with the source
+    // block by block and pwrite only the blocks that differ. Saves the writes
+    // (and CoW/snapshot churn) when big files change in small regions, at the
+    // cost of reading both sides. Not atomic: an interrupted update leaves a
+    // mix of old and new blocks.
+    bool delta = false;
+    uint64_t delta_block_size = uint64_t{64} << 10;
+};
+
+// Copies src over dst (creating or truncating it) and copies the permission
+// bits, like std::filesystem::copy_file with overwrite_existing. Tries each
+// method in order; a method that isn't supported between two devices is
+// remembered per (source st_dev, destination st_dev) and skipped from then on.
+// Files of at least options.parallel_threshold bytes that can't be reflinked
+// are fallocate'd up front and copied range by range with offset-based
+// copy_file_range (pread/pwrite where unsupported) by options.workers threads.
+// With options.delta, an existing non-empty destination is updated in place
+// instead (Method::Delta), its ranges compared by the same worker threads.
+// Throws std::filesystem::filesystem_error on failure.
+Method copy_file(const std::filesystem::path& src, const std::filesystem::path& dst,
+                 const CopyOptions& options = {});
+
+// copy_file for src_name in the open directory src_dir and dst_name in dst_dir
+// (either may be AT_FDCWD), so a batch from one directory pays path lookup once
+Method copy_file_at(int src_dir, const char* src_name, int dst_dir, const char* dst_name,
+                    const CopyOptions& options = {});
+
+// Opening half of copy_file: src for reading, dst created or truncated with
+// src's permission bits. A source that isn't a regular file fails with EINVAL,
+// src and dst naming the same file with EEXIST. Returns 0 (the caller then owns
+// both descriptors) or an errno value.
+int open_for_copy(const std::filesystem::path& src, const std::filesystem::path& dst,
+                  int& src_fd, int& dst_fd, struct stat& src_st, struct stat& dst_st);
+int open_for_copy_at(int src_dir, const char* src_name, int dst_dir, const char* dst_name,
+                     int& src_fd, int& dst_fd, struct stat& src_st, struct stat& dst_st);
+
+// True if both files have the same size and bytes. Throws
+// std::filesystem::filesystem_error if either can't be read.
+bool same_contents(const std::filesystem::path& a, const std::filesystem::path& b);
+
+// Same chain over already-open descriptors: copies size bytes of src_fd into
+// the (empty) dst_fd. Returns -1 and sets errno on failure.
+int copy_data(int src_fd, int dst_fd, uint64_t size, dev_t src_dev, dev_t dst_dev, Method& used);
+
+} // namespace copier
@@ -0,0 +1,187 @@
+#include "duplicates.hpp"
+#include "copier.hpp"
+#include "executor.hpp"
+#include "hasher.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+namespace duplicates {
+
+namespace {
+
+// Runs hash(file, digest) for every file on `threads` workers. Files it fails
+// on are reported and get failed[i] set.
+template <typename Hash>
+std::vector<uint64_t> hash_all(const std::vector<File>& files, size_t threads, std::vector<bool>& failed,
+                               std::vector<std::string>& errors, Hash hash) {
+    std::vector<uint64_t> digests(files.size());
+    std::vector<int> results(files.size());
+    executor::for_each_index(files.size(), threads, [&](uint64_t i) {
+        int fd = openat(files[i].at_fd(), files[i].at_name().c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            results[i] = errno;
+            return 0;
+        }
+        results[i] = hash(fd, files[i], digests[i]);
+        close(fd);
+        return 0;   // one unreadable file doesn't stop the others
+    });
+
+    failed.assign(files.size(), false);
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (results[i] == 0) continue;
+        failed[i] = true;
+        errors.push_back("Failed to hash " + files[i].path().string() + ": " + std::strerror(results[i]));
+    }
+    return digests;
+}
+
+// Splits files into groups of equal key, dropping groups of one
+template <typename Key>
+std::vector<std::vector<File>> collisions(std::vector<File> files, const std::vector<Key>& keys,
+                                          const std::vector<bool>& failed) {
+    std::map<Key, std::vector<File>> buckets;
+    for (size_t i = 0; i < files.size(); ++i) {
+        if (!failed.empty() && failed[i]) continue;
+        buckets[keys[i]].push_back(std::move(files[i]));
+    }
+    std::vector<std::vector<File>> groups;
+    for (auto& [key, group] : buckets) {
+        if (group.size() > 1) groups.push_back(std::move(group));
+    }
+    return groups;
+}
+
+std::vector<File> flatten(std::vector<std::vector<File>>& groups) {
+    std::vector<File> files;
+    for (auto& group : groups) {
+        std::move(group.begin(), group.end(), std::back_inserter(files));
+    }
+    return files;
+}
+
+} // namespace
+
+std::vector<std::vector<File>> find(std::vector<File> files, size_t threads, FunnelStats& stats,
+                                    std::vector<std::string>& errors) {
+    // Stage 0: drop empty files and extra names of an inode already seen
+    std::set<std::pair<dev_t, ino_t>> inodes;
+    std::erase_if(files, [&](const File& file) {
+        return file.size == 0 || !inodes.emplace(file.device, file.inode).second;
+    });
+
+    // Stage 1: sizes, already known from the scan
+    std::vector<uint64_t> sizes;
+    for (const auto& file : files) sizes.push_back(file.size);
+    auto by_size = collisions(std::move(files), sizes, {});
+
+    // Stage 2: first and last kEdgeSize bytes of each size collision
+    std::vector<File> candidates = flatten(by_size);
+    std::vector<bool> failed;
+    std::atomic<uint64_t> bytes_read{0};
+    std::vector<uint64_t> edges = hash_all(candidates, threads, failed, errors,
+        [&](int fd, const File& file, uint64_t& digest) {
+            if (file.size <= 2 * kEdgeSize) {
+                bytes_read += file.size;
+                return hasher::hash_range(fd, 0, file.size, digest);
+            }
+            uint64_t ends[2];
+            int err = hasher::hash_range(fd, 0, kEdgeSize, ends[0]);
+            if (err == 0) err = hasher::hash_range(fd, file.size - kEdgeSize, kEdgeSize, ends[1]);
+            bytes_read += 2 * kEdgeSize;
+            digest = hasher::xxh64(ends, sizeof(ends), file.size);
+            return err;
+        });
+    stats.partial_hashed = candidates.size();
+
+    std::vector<std::pair<uint64_t, uint64_t>> edge_keys;
+    for (size_t i = 0; i < candidates.size(); ++i) edge_keys.emplace_back(candidates[i].size, edges[i]);
+    auto by_edges = collisions(std::move(candidates), edge_keys, failed);
+
+    // Stage 3: full contents, only where the edges didn't already cover them
+    std::vector<std::vector<File>> groups;
+    std::vector<File> survivors;
+    for (auto& group : by_edges) {
+        if (group.front().size <= 2 * kEdgeSize) {
+            groups.push_back(std::move(group));
+        } else {
+            std::move(group.begin(), group.end(), std::back_inserter(survivors));
+        }
+    }
+    // Many files at once already keep every worker busy, so each is read by one
+    hasher::HashOptions whole;
+    whole.workers = 1;
+    std::vector<uint64_t> full = hash_all(survivors, threads, failed, errors,
+        [&](int fd, const File& file, uint64_t& digest) {
+            bytes_read += file.size;
+            return hasher::hash_fd(fd, file.size, digest, whole);
+        });
+    stats.fully_hashed = survivors.size();
+    stats.bytes_read = bytes_read.load();
+
+    std::vector<std::pair<uint64_t, uint64_t>> full_keys;
+    for (size_t i = 0; i < survivors.size(); ++i) full_keys.emplace_back(survivors[i].size, full[i]);
+    for (auto& group : collisions(std::move(survivors), full_keys, failed)) {
+        groups.push_back(std::move(group));
+    }
+
+    for (auto& group : groups) {
+        std::sort(group.begin(), group.end(), [](const File& a, const File& b) { return a.path() < b.path(); });
+    }
+    std::sort(groups.begin(), groups.end(), [](const auto& a, const auto& b) { return a.front().path() < b.front().path(); });
+    return groups;
+}
+
+int link_duplicate(const File& keeper, const File& duplicate, LinkMode mode) {
+    try {
+        if (!copier::same_contents(keeper.path(), duplicate.path())) return EBADE;
+    } catch (const std::filesystem::filesystem_error& e) {
+        return e.code().value();
+    }
+
+    if (mode == LinkMode::Hardlink) {
+        // Link under a temporary name, then rename over the duplicate so its
+        // name never goes missing
+        std::string temp = "." + duplicate.name + ".smartfile-" + std::to_string(getpid());
+        if (duplicate.at_fd() == AT_FDCWD) temp = (duplicate.dir->path / temp).string();
+        if (linkat(keeper.at_fd(), keeper.at_name().c_str(), duplicate.at_fd(), temp.c_str(), 0) != 0) {
+            return errno;
+        }
+        if (renameat(duplicate.at_fd(), temp.c_str(), duplicate.at_fd(), duplicate.at_name().c_str()) != 0) {
+            int err = errno;
+            unlinkat(duplicate.at_fd(), temp.c_str(), 0);
+            return err;
+        }
+        return 0;
+    }
+
+#ifdef __linux__
+    int src_fd = openat(keeper.at_fd(), keeper.at_name().c_str(), O_RDONLY | O_CLOEXEC);
+    if (src_fd < 0) return errno;
+    int dst_fd = openat(duplicate.at_fd(), duplicate.at_name().c_str(), O_WRONLY | O_CLOEXEC);
+    if (dst_fd < 0) {
+        int err = errno;
+        close(src_fd);
+        return err;
+    }
+    int err = ioctl(dst_fd, FICLONE, src_fd) == 0 ? 0 : errno;
+    close(src_fd);
+    close(dst_fd);
+    return err;
+#else
+    return EOPNOTSUPP;
+#endif
+}
+
+} // namespace duplicates
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/types.h>
+#include "scanner.hpp"
+
+namespace duplicates {
+
+// A candidate file: its scanned directory (used through its descriptor if it
+// was kept open, else by path) and name, plus what stat said about it
+struct File {
+    std::shared_ptr<const scanner::Directory> dir;
+    std::string name;
+    uint64_t size = 0;
+    dev_t device = 0;
+    ino_t inode = 0;
+
+    std::filesystem::path path() const { return dir->path / name; }
+    int at_fd() const { return dir->dir_fd() >= 0 ? dir->dir_fd() : AT_FDCWD; }
+    std::string at_name() const { return dir->dir_fd() >= 0 ? name : path().string(); }
+};
+
+// Bytes hashed at each end of a file in the partial stage
+constexpr uint64_t kEdgeSize = uint64_t{64} << 10;
+
+struct FunnelStats {
+    size_t partial_hashed = 0;    // files whose first/last kEdgeSize were read
+    size_t fully_hashed = 0;      // files read completely
+    uint64_t bytes_read = 0;
+};
+
+// Groups files with identical contents, cheapest test first: files are
+// bucketed by size, only size collisions get their first and last kEdgeSize
+// bytes hashed, and only files that still collide are hashed in full (files
+// no larger than two edges are already fully covered by the partial stage).
+// Each stage runs on `threads` workers. Names of one inode count once; empty
+// files are ignored. Each returned group is sorted by path. Files that can't
+// be read are reported in errors and dropped.
+std::vector<std::vector<File>> find(std::vector<File> files, size_t threads, FunnelStats& stats,
+                                    std::vector<std::string>& errors);
+
+enum class LinkMode { Hardlink, Reflink };
+
+// Makes duplicate share keeper's data: a hardlink atomically replaces the
+// duplicate's name (same filesystem only), a reflink clones keeper's extents
+// into the duplicate in place (btrfs, XFS, ...). The contents are compared
+// byte for byte first, so a hash collision can't lose data. Returns 0 or an
+// errno value (EBADE if the contents differ after all).
+int link_duplicate(const File& keeper, const File& duplicate, LinkMode mode);
+
+} // namespace duplicates
@@ -0,0 +1,190 @@
+#include "executor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <sys/sysmacros.h>
+
+namespace executor {
+
+namespace {
+
+// Reads a 0/1 flag from a block device's sysfs directory. Partitions don't have
+// a queue/ directory of their own, so fall back to the parent disk.
+bool read_block_flag(dev_t dev, const std::string& attribute) {
+    std::string base = "/sys/dev/block/" + std::to_string(major(dev)) + ":" + std::to_string(minor(dev));
+    for (const std::string& dir : {base, base + "/.."}) {
+        std::ifstream file(dir + "/" + attribute);
+        int value = 0;
+        if (file >> value) return value != 0;
+    }
+    return false;
+}
+
+} // namespace
+
+size_t default_thread_count() {
+    size_t hw = std::thread::hardware_concurrency();
+    return std::max<size_t>(8, 2 * hw);
+}
+
+size_t device_concurrency_limit(dev_t dev, size_t fast_limit, size_t slow_limit) {
+    if (read_block_flag(dev, "queue/rotational") || read_block_flag(dev, "removable")) {
+        return slow_limit;
+    }
+    return fast_limit;
+}
+
+Executor::Executor(const ExecutorOptions& options) : options_(options) {
+    size_t threads = options_.threads > 0 ? options_.threads : default_thread_count();
+    workers_.reserve(threads);
+    for (size_t i = 0; i < threads; ++i) {
+        workers_.emplace_back([this] { work(); });
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void Executor::submit(std::vector<dev_t> devices, std::function<void()> task) {
+    // Look up limits outside the lock; sysfs reads are slow-ish
+    for (dev_t dev : devices) {
+        bool known;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            known = devices_.count(dev) > 0;
+        }
+        if (!known) {
+            size_t limit = device_concurrency_limit(dev, options_.device_limit, options_.slow_device_limit);
+            std::lock_guard<std::mutex> lock(mutex_);
+            devices_[dev].limit = std::max<size_t>(1, limit);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_ready_.wait(lock, [&] { return queue_.size() < options_.queue_capacity; });
+    queue_.push_back({std::move(devices), std::move(task)});
+    work_ready_.notify_one();
+}
+
+void Executor::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [&] { return queue_.empty() && running_ == 0; });
+    if (error_) {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+Executor::DeviceSlots& Executor::slots(dev_t dev) {
+    return devices_[dev];
+}
+
+bool Executor::can_start(const Task& task) {
+    for (dev_t dev : task.devices) {
+        const auto& device = slots(dev);
+        if (device.in_flight >= device.limit) return false;
+    }
+    return true;
+}
+
+void Executor::work() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        // Oldest task whose devices all have a free slot
+        auto next = queue_.end();
+        work_ready_.wait(lock, [&] {
+            if (stopping_ && queue_.empty()) return true;
+            next = std::find_if(queue_.begin(), queue_.end(), [&](const Task& t) { return can_start(t); });
+            return next != queue_.end();
+        });
+        if (next == queue_.end()) return;
+
+        Task task = std::move(*next);
+        queue_.erase(next);
+        for (dev_t dev : task.devices) slots(dev).in_flight++;
+        running_++;
+        space_ready_.notify_one();
+
+        lock.unlock();
+        try {
+            task.run();
+        } catch (...) {
+            std::lock_guard<std::mutex> error_lock(mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+        lock.lock();
+
+        for (dev_t dev : task.devices) slots(dev).in_flight--;
+        running_--;
+        // A freed device slot may unblock tasks other workers skipped
+        work_ready_.notify_all();
+        if (queue_.empty() && running_ == 0) idle_.notify_all();
+    }
+}
+
+int for_each_index(uint64_t count, size_t workers, const std::function<int(uint64_t)>& work) {
+    workers = static_cast<size_t>(std::min<uint64_t>(std::max<size_t>(workers, 1), count));
+    std::atomic<uint64_t> next{0};
+    std::atomic<int> error{0};
+
+    auto run = [&] {
+        for (;;) {
+            uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+            if (index >= count || error.load(std::memory_order_relaxed) != 0) return;
+            if (int err = work(index); err != 0) {
+                int expected = 0;
+                error.compare_exchange_strong(expected, err);
+                return;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i) {
+        threads.emplace_back(run);
+    }
+    run();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return error.load();
+}
+
+std::shared_ptr<Executor> ExecutorPool::acquire(const ExecutorOptions& options) {
+    std::unique_ptr<Executor> executor;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = std::find_if(idle_.begin(), idle_.end(), [&](const auto& entry) { return entry.first == options; });
+        if (it != idle_.end()) {
+            executor = std::move(it->second);
+            idle_.erase(it);
+        }
+    }
+    if (!executor) executor = std::make_unique<Executor>(options);
+    return std::shared_ptr<Executor>(executor.release(), [this, options](Executor* released) {
+        release(options, released);
+    });
+}
+
+void ExecutorPool::release(const ExecutorOptions& options, Executor* executor) {
+    std::unique_ptr<Executor> owned(executor);
+    try {
+        owned->wait();   // a caller that bailed out may have left tasks behind
+    } catch (...) {
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < max_idle_) idle_.emplace_back(options, std::move(owned));
+    // otherwise its threads are joined as owned goes out of scope
+}
+
+} // namespace executor
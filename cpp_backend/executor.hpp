@@ -0,0 +1,107 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+namespace executor {
+
+struct ExecutorOptions {
+    size_t threads = 0;                 // worker count, 0 = default_thread_count()
+    size_t queue_capacity = 1024;       // submit() blocks beyond this many queued tasks
+    size_t device_limit = 32;           // concurrent tasks per SSD/NVMe/network device
+    size_t slow_device_limit = 2;       // concurrent tasks per rotational/removable disk
+
+    bool operator==(const ExecutorOptions&) const = default;
+};
+
+// I/O bound work wants more threads than cores
+size_t default_thread_count();
+
+// Concurrency limit for a device: slow_limit for rotational or removable block
+// devices (per /sys/dev/block), fast_limit for everything else
+size_t device_concurrency_limit(dev_t dev, size_t fast_limit, size_t slow_limit);
+
+// Calls work(index) for every index below count on up to workers threads (the
+// caller's included), each claiming the next unclaimed index. work returns 0,
+// or an errno value, which stops everyone. Returns 0 or the first such value.
+// Used to split one large file into ranges.
+int for_each_index(uint64_t count, size_t workers, const std::function<int(uint64_t)>& work);
+
+// Fixed worker pool with a bounded task queue. Each task names the devices it
+// touches (keyed by st_dev) and only starts while every one of them is below its
+// concurrency limit, so an NVMe target can take dozens of parallel operations
+// while a USB disk sees just a couple. Tasks blocked on a busy device don't hold
+// back tasks for other devices.
+class Executor {
+public:
+    explicit Executor(const ExecutorOptions& options = {});
+    ~Executor();
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Blocks while the queue is full
+    void submit(std::vector<dev_t> devices, std::function<void()> task);
+
+    // Waits for every submitted task. Rethrows the first exception a task threw.
+    void wait();
+
+    size_t thread_count() const { return workers_.size(); }
+
+private:
+    struct Task {
+        std::vector<dev_t> devices;
+        std::function<void()> run;
+    };
+
+    struct DeviceSlots {
+        size_t limit = 0;
+        size_t in_flight = 0;
+    };
+
+    void work();
+    bool can_start(const Task& task);
+    DeviceSlots& slots(dev_t dev);
+
+    ExecutorOptions options_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable space_ready_;
+    std::condition_variable idle_;
+    std::deque<Task> queue_;
+    std::map<dev_t, DeviceSlots> devices_;
+    size_t running_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+    std::vector<std::thread> workers_;
+};
+
+// Idle executors kept for reuse, so a long-running process doesn't start new
+// worker threads (and their per-thread io_uring rings) for every command
+class ExecutorPool {
+public:
+    explicit ExecutorPool(size_t max_idle = 4) : max_idle_(max_idle) {}
+
+    // An executor with these options for the caller alone. Dropping the handle
+    // waits for its tasks and puts it back.
+    std::shared_ptr<Executor> acquire(const ExecutorOptions& options);
+
+private:
+    void release(const ExecutorOptions& options, Executor* executor);
+
+    size_t max_idle_;
+    std::mutex mutex_;
+    std::vector<std::pair<ExecutorOptions, std::unique_ptr<Executor>>> idle_;
+};
+
+} // namespace executor
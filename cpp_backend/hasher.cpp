@@ -0,0 +1,244 @@
+#include "hasher.hpp"
+#include "executor.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <system_error>
+#include <vector>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace hasher {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+constexpr size_t kReadSize = 1 << 20;
+constexpr size_t kReadAlignment = 4096;
+
+inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// Little-endian loads; memcpy compiles to a plain mov
+inline uint64_t load64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+inline uint32_t load32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+inline uint64_t lane_round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t merge_round(uint64_t acc, uint64_t value) {
+    acc ^= lane_round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+// The four lanes are independent, so the CPU keeps all of them in flight
+inline const unsigned char* consume_stripes(uint64_t acc[4], const unsigned char* p, const unsigned char* end) {
+    uint64_t v1 = acc[0], v2 = acc[1], v3 = acc[2], v4 = acc[3];
+    while (end - p >= 32) {
+        v1 = lane_round(v1, load64(p));
+        v2 = lane_round(v2, load64(p + 8));
+        v3 = lane_round(v3, load64(p + 16));
+        v4 = lane_round(v4, load64(p + 24));
+        p += 32;
+    }
+    acc[0] = v1;
+    acc[1] = v2;
+    acc[2] = v3;
+    acc[3] = v4;
+    return p;
+}
+
+uint64_t finish(uint64_t h, const unsigned char* p, size_t left) {
+    for (; left >= 8; p += 8, left -= 8) {
+        h ^= lane_round(0, load64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (left >= 4) {
+        h ^= uint64_t{load32(p)} * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        left -= 4;
+    }
+    for (; left > 0; ++p, --left) {
+        h ^= *p * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t converge(const uint64_t acc[4]) {
+    uint64_t h = rotl(acc[0], 1) + rotl(acc[1], 7) + rotl(acc[2], 12) + rotl(acc[3], 18);
+    for (int i = 0; i < 4; ++i) {
+        h = merge_round(h, acc[i]);
+    }
+    return h;
+}
+
+// Page-aligned read buffer per thread; aligned so it also suits O_DIRECT reads
+char* read_buffer() {
+    thread_local std::unique_ptr<char, void (*)(void*)> buffer(
+        static_cast<char*>(std::aligned_alloc(kReadAlignment, kReadSize)), std::free);
+    return buffer.get();
+}
+
+} // namespace
+
+uint64_t xxh64(const void* data, size_t size, uint64_t seed) {
+    auto* p = static_cast<const unsigned char*>(data);
+    auto* end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t acc[4] = {seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1};
+        p = consume_stripes(acc, p, end);
+        h = converge(acc);
+    } else {
+        h = seed + kPrime5;
+    }
+    h += size;
+    return finish(h, p, end - p);
+}
+
+Xxh64::Xxh64(uint64_t seed)
+    : seed_(seed), acc_{seed + kPrime1 + kPrime2, seed + kPrime2, seed, seed - kPrime1} {}
+
+void Xxh64::update(const void* data, size_t size) {
+    auto* p = static_cast<const unsigned char*>(data);
+    auto* end = p + size;
+    total_ += size;
+
+    if (buffered_ > 0) {
+        size_t take = std::min(size, sizeof(stripe_) - buffered_);
+        std::memcpy(stripe_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        if (buffered_ < sizeof(stripe_)) return;
+        consume_stripes(acc_, stripe_, stripe_ + sizeof(stripe_));
+        buffered_ = 0;
+    }
+
+    p = consume_stripes(acc_, p, end);
+    buffered_ = end - p;
+    std::memcpy(stripe_, p, buffered_);
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t h = total_ >= 32 ? converge(acc_) : seed_ + kPrime5;
+    h += total_;
+    return finish(h, stripe_, buffered_);
+}
+
+int hash_range(int fd, uint64_t offset, uint64_t length, uint64_t& digest) {
+    char* buffer = read_buffer();
+    if (!buffer) return ENOMEM;
+
+    Xxh64 state;
+    for (uint64_t end = offset + length; offset < end;) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(kReadSize, end - offset));
+        ssize_t n = pread(fd, buffer, want, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (n == 0) break;
+        state.update(buffer, n);
+        offset += n;
+    }
+    digest = state.digest();
+    return 0;
+}
+
+int hash_fd(int fd, uint64_t size, uint64_t& digest, const HashOptions& options) {
+    uint64_t leaf_size = std::max<uint64_t>(options.leaf_size, kReadSize);
+#ifdef __linux__
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    if (size <= leaf_size) {
+        return hash_range(fd, 0, size, digest);
+    }
+
+    // Leaves are independent, so they spread over threads like copy ranges do
+    uint64_t leaves = (size + leaf_size - 1) / leaf_size;
+    std::vector<uint64_t> leaf_digests(leaves);
+    int err = executor::for_each_index(leaves, options.workers, [&](uint64_t index) {
+        uint64_t begin = index * leaf_size;
+        return hash_range(fd, begin, std::min(leaf_size, size - begin), leaf_digests[index]);
+    });
+    if (err != 0) return err;
+
+    std::vector<unsigned char> packed(leaves * 8);
+    for (uint64_t i = 0; i < leaves; ++i) {
+        for (int b = 0; b < 8; ++b) {
+            packed[i * 8 + b] = static_cast<unsigned char>(leaf_digests[i] >> (8 * b));
+        }
+    }
+    digest = xxh64(packed.data(), packed.size(), size);
+    return 0;
+}
+
+uint64_t hash_file_at(int dir, const char* name, const HashOptions& options) {
+    auto fail = [&](int err) -> uint64_t {
+        throw std::filesystem::filesystem_error("cannot hash file", name,
+                                                std::error_code(err, std::generic_category()));
+    };
+
+    int fd = openat(dir, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return fail(errno);
+
+    struct stat st;
+    int err = 0;
+    uint64_t digest = 0;
+    if (fstat(fd, &st) != 0) {
+        err = errno;
+    } else if (!S_ISREG(st.st_mode)) {
+        err = EINVAL;
+    } else {
+        err = hash_fd(fd, st.st_size, digest, options);
+    }
+    close(fd);
+    if (err != 0) return fail(err);
+    return digest;
+}
+
+uint64_t hash_file(const std::filesystem::path& path, const HashOptions& options) {
+    return hash_file_at(AT_FDCWD, path.c_str(), options);
+}
+
+std::string to_hex(uint64_t digest) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string hex(16, '0');
+    for (int i = 15; i >= 0; --i, digest >>= 4) {
+        hex[i] = kDigits[digest & 0xf];
+    }
+    return hex;
+}
+
+} // namespace hasher
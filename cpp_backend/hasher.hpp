@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <fcntl.h>
+
+namespace hasher {
+
+// XXH64 of a buffer; matches `xxhsum -H64`
+uint64_t xxh64(const void* data, size_t size, uint64_t seed = 0);
+
+// Streaming XXH64: update() any number of times, digest() any time
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    uint64_t seed_;
+    uint64_t acc_[4];
+    uint64_t total_ = 0;
+    unsigned char stripe_[32];
+    size_t buffered_ = 0;
+};
+
+// Files up to leaf_size are hashed in one pass, so their digest is the plain
+// XXH64 of the contents. Larger files are split into leaf_size leaves hashed
+// by up to workers threads; the digest is then the XXH64 (seeded with the file
+// size) of the leaf digests in order. The split is fixed by leaf_size, never
+// by the thread count, so digests compare across runs and machines as long as
+// leaf_size is left alone.
+struct HashOptions {
+    uint64_t leaf_size = uint64_t{64} << 20;
+    size_t workers = 4;
+};
+
+// Hashes up to length bytes of fd starting at offset (fewer at EOF), read with
+// pread into large aligned buffers. Returns 0 or an errno value.
+int hash_range(int fd, uint64_t offset, uint64_t length, uint64_t& digest);
+
+// Content digest of the first size bytes of fd, as described above. Returns 0
+// or an errno value.
+int hash_fd(int fd, uint64_t size, uint64_t& digest, const HashOptions& options = {});
+
+// Content digest of a regular file (name relative to dir, or AT_FDCWD). Throws
+// std::filesystem::filesystem_error if it can't be opened or read.
+uint64_t hash_file_at(int dir, const char* name, const HashOptions& options = {});
+uint64_t hash_file(const std::filesystem::path& path, const HashOptions& options = {});
+
+// 16 lowercase hex digits
+std::string to_hex(uint64_t digest);
+
+} // namespace hasher
@@ -0,0 +1,133 @@
+#include "ignore.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace utils {
+
+namespace {
+
+// Small ignore files are read in one go; anything huge is not an ignore file
+constexpr size_t kMaxIgnoreFileSize = 1 << 20;
+
+// Returns 0 or an errno value, EFBIG if the file is over kMaxIgnoreFileSize.
+// A file only partly read is not returned at all.
+int read_small_file(int dir_fd, const std::string& name, std::string& contents) {
+    int fd = openat(dir_fd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd < 0) return errno;
+
+    char buffer[16384];
+    int err = 0;
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            err = errno;
+            break;
+        }
+        if (n == 0) break;
+        if (contents.size() + n > kMaxIgnoreFileSize) {
+            err = EFBIG;
+            break;
+        }
+        contents.append(buffer, n);
+    }
+    close(fd);
+    if (err != 0) contents.clear();
+    return err;
+}
+
+} // namespace
+
+IgnoreList::IgnoreList(std::shared_ptr<const IgnoreList> parent, std::string base_rel)
+    : parent_(std::move(parent)), base_rel_(std::move(base_rel)) {}
+
+void IgnoreList::add_rule(std::string_view line, bool case_insensitive) {
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    while (!line.empty() && (line.back() == ' ' || line.back() == '\t')) line.remove_suffix(1);
+    if (line.empty() || line.front() == '#') return;
+
+    bool negate = line.front() == '!';
+    if (negate) line.remove_prefix(1);
+
+    bool dir_only = !line.empty() && line.back() == '/';
+    if (dir_only) line.remove_suffix(1);
+
+    bool anchored = line.find('/') != std::string_view::npos;
+    if (!line.empty() && line.front() == '/') line.remove_prefix(1);
+    if (line.empty()) return;
+
+    rules_.push_back({GlobMatcher(line, case_insensitive), negate, dir_only, anchored});
+}
+
+std::shared_ptr<const IgnoreList> IgnoreList::load(int dir_fd, const std::vector<std::string>& file_names,
+                                                   std::shared_ptr<const IgnoreList> parent,
+                                                   const std::string& base_rel,
+                                                   std::vector<std::string>& errors) {
+    std::shared_ptr<IgnoreList> list;
+    for (const auto& file_name : file_names) {
+        std::string contents;
+        int err = read_small_file(dir_fd, file_name, contents);
+        // Absent is the usual case, and symlinked ignore files aren't followed
+        if (err == ENOENT || err == ELOOP || err == ENOTDIR) continue;
+        if (err != 0) {
+            errors.push_back(file_name + ": " +
+                             (err == EFBIG ? std::string("larger than 1 MB") : std::strerror(err)) +
+                             ", none of its rules applied");
+            continue;
+        }
+
+        if (!list) list = std::make_shared<IgnoreList>(parent, base_rel);
+        std::string_view rest = contents;
+        for (size_t line = 1; !rest.empty(); ++line) {
+            size_t newline = rest.find('\n');
+            try {
+                list->add_rule(rest.substr(0, newline));
+            } catch (const std::invalid_argument& e) {
+                errors.push_back(file_name + ":" + std::to_string(line) + ": " + e.what() + ", rule skipped");
+            }
+            if (newline == std::string_view::npos) break;
+            rest.remove_prefix(newline + 1);
+        }
+    }
+
+    if (!list || list->empty()) return parent;
+    return list;
+}
+
+bool IgnoreList::ignored(const std::string& dir_rel, std::string_view name, bool is_dir) const {
+    // Path relative to this level's base, built only if an anchored rule needs it
+    thread_local std::string path;
+    bool have_path = false;
+
+    for (auto rule = rules_.rbegin(); rule != rules_.rend(); ++rule) {
+        if (rule->dir_only && !is_dir) continue;
+
+        bool hit;
+        if (rule->anchored) {
+            if (!have_path) {
+                std::string_view rel = dir_rel;
+                if (!base_rel_.empty()) {
+                    // base_rel_ is an ancestor of dir_rel (or dir_rel itself)
+                    rel.remove_prefix(std::min(rel.size(), base_rel_.size() + 1));
+                }
+                path.assign(rel);
+                if (!path.empty()) path.push_back('/');
+                path.append(name);
+                have_path = true;
+            }
+            hit = rule->glob.matches(path);
+        } else {
+            hit = rule->glob.matches(name);
+        }
+
+        if (hit) return !rule->negate;
+    }
+
+    return parent_ ? parent_->ignored(dir_rel, name, is_dir) : false;
+}
+
+} // namespace utils
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "pattern.hpp"
+
+namespace utils {
+
+// Ignore files loaded per directory when a command asks for them
+inline const std::vector<std::string> kIgnoreFileNames = {".gitignore", ".smartfileignore"};
+
+// One level of exclude rules: the command's --exclude globs at the scan root, or
+// one .gitignore-style file. Levels chain to their parent; the deepest level with
+// a matching rule decides, and within a level the last matching rule wins.
+class IgnoreList {
+public:
+    // base_rel is the directory the rules are relative to ("" for the scan root)
+    IgnoreList(std::shared_ptr<const IgnoreList> parent, std::string base_rel);
+
+    // Adds one rule in gitignore syntax: '#' comments, '!' negation, trailing '/'
+    // for directories only, and a leading or inner '/' to anchor the glob to
+    // base_rel. Unanchored globs match the entry name at any depth.
+    void add_rule(std::string_view line, bool case_insensitive = false);
+
+    // Reads an ignore file relative to dir_fd. Returns the parent unchanged if the
+    // file doesn't exist or holds no rules. Rules that can't be compiled are
+    // skipped and reported in errors as "<file>:<line>: <reason>"; a file that
+    // can't be read whole (over 1 MB, or a read error) is skipped entirely and
+    // reported as "<file>: <reason>".
+    static std::shared_ptr<const IgnoreList> load(int dir_fd, const std::vector<std::string>& file_names,
+                                                  std::shared_ptr<const IgnoreList> parent,
+                                                  const std::string& base_rel,
+                                                  std::vector<std::string>& errors);
+
+    // True if name inside the directory at dir_rel (relative to the scan root) is excluded
+    bool ignored(const std::string& dir_rel, std::string_view name, bool is_dir) const;
+
+    bool empty() const { return rules_.empty(); }
+
+private:
+    struct Rule {
+        GlobMatcher glob;
+        bool negate;
+        bool dir_only;
+        bool anchored;
+    };
+
+    std::shared_ptr<const IgnoreList> parent_;
+    std::string base_rel_;
+    std::vector<Rule> rules_;
+};
+
+} // namespace utils
@@ -1,11 +1,353 @@
 #include <iostream>
 #include <string>
+#include <sstream>
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
 #include <nlohmann/json.hpp>
 #include "actions.hpp"
+#include "server.hpp"
 
 using json = nlohmann::json;
 
-int main() {
+static uint64_t parse_size_field(const json& value, const std::string& name) {
+    if (value.is_number_unsigned()) return value.get<uint64_t>();
+    if (value.is_string()) {
+        if (auto size = utils::parse_size(value.get<std::string>())) return *size;
+    }
+    throw std::invalid_argument("Invalid " + name + ": " + value.dump());
+}
+
+static int64_t parse_duration_field(const json& value, const std::string& name) {
+    if (value.is_number_unsigned()) return value.get<int64_t>();
+    if (value.is_string()) {
+        if (auto seconds = utils::parse_duration(value.get<std::string>())) return *seconds;
+    }
+    throw std::invalid_argument("Invalid " + name + ": " + value.dump());
+}
+
+// Fills a Command from a request object. Throws std::invalid_argument for
+// fields of the wrong kind.
+static actions::Command parse_command(const json& j) {
+    actions::Command cmd;
+    if (j.contains("action") && j["action"].is_string()) {
+        cmd.action = j["action"].get<std::string>();
+    } else {
+        throw std::invalid_argument("action field is missing or not a string");
+    }
+    
+    if (j.contains("pattern") && j["pattern"].is_string()) {
+        cmd.pattern = j["pattern"].get<std::string>();
+    } else {
+        cmd.pattern = "";
+    }
+    
+    if (j.contains("source") && j["source"].is_string()) {
+        cmd.source = j["source"].get<std::string>();
+    } else {
+        cmd.source = "";
+    }
+    
+    if (j.contains("destination") && j["destination"].is_string()) {
+        cmd.destination = j["destination"].get<std::string>();
+    } else {
+        cmd.destination = "";
+    }
+    
+    cmd.dry_run = j.value("dry_run", false);
+    cmd.force = j.value("force", false);
+    cmd.recursive = j.value("recursive", false);
+    cmd.verbose = j.value("verbose", false);
+    cmd.threads = j.value("threads", size_t{0});
+    cmd.io_threads = j.value("io_threads", size_t{0});
+    cmd.device_limit = j.value("device_limit", size_t{0});
+    cmd.slow_device_limit = j.value("slow_device_limit", size_t{0});
+    cmd.use_ignore_files = j.value("ignore_files", false);
+    cmd.use_index = j.value("index", false);
+    
+    // Sizes and ages may be plain numbers (bytes / seconds) or strings like "100MB", "30d"
+    if (j.contains("min_size")) cmd.filters.min_size = parse_size_field(j["min_size"], "min_size");
+    if (j.contains("max_size")) cmd.filters.max_size = parse_size_field(j["max_size"], "max_size");
+    if (j.contains("older_than")) cmd.filters.older_than = parse_duration_field(j["older_than"], "older_than");
+    if (j.contains("newer_than")) cmd.filters.newer_than = parse_duration_field(j["newer_than"], "newer_than");
+    if (j.contains("large_file_threshold")) {
+        cmd.large_file_threshold = parse_size_field(j["large_file_threshold"], "large_file_threshold");
+    }
+    cmd.copy_workers = j.value("copy_workers", size_t{0});
+    cmd.verify = j.value("verify", false);
+    cmd.sync = j.value("sync", false);
+    cmd.checksum = j.value("checksum", false);
+    cmd.delta = j.value("delta", false);
+    cmd.dedupe = j.value("dedupe", std::string());
+    cmd.use_io_uring = j.value("io_uring", false);
+    cmd.io_uring_depth = j.value("io_uring_depth", 0u);
+    if (j.contains("owner")) {
+        cmd.filters.owner = j["owner"].is_string() ? j["owner"].get<std::string>()
+                                                   : std::to_string(j["owner"].get<unsigned>());
+    }
+    if (j.contains("mode")) {
+        // Octal permission string ("644") or a number that is already the mode
+        cmd.filters.mode = j["mode"].is_string() ? std::stoul(j["mode"].get<std::string>(), nullptr, 8)
+                                                 : j["mode"].get<unsigned>();
+    }
+    
+    // Excludes may be a list or a comma-separated string
+    if (j.contains("exclude")) {
+        if (j["exclude"].is_array()) {
+            for (const auto& item : j["exclude"]) {
+                if (item.is_string()) cmd.exclude.push_back(item.get<std::string>());
+            }
+        } else if (j["exclude"].is_string()) {
+            std::stringstream list(j["exclude"].get<std::string>());
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                if (!item.empty()) cmd.exclude.push_back(item);
+            }
+        }
+    }
+    return cmd;
+}
+
+static json result_to_json(const utils::FileOpResult& result) {
+    json output;
+    output["success"] = result.success;
+    output["operation"] = result.operation;
+    output["message"] = result.message;
+    output["files_scanned"] = result.files_scanned;
+    output["files_matched"] = result.files_matched;
+    output["files_affected"] = result.files_affected;
+    output["start_time"] = std::to_string(result.start_time.time_since_epoch().count());
+    output["end_time"] = std::to_string(result.end_time.time_since_epoch().count());
+    
+    // Add errors if any
+    if (!result.errors.empty()) {
+        output["errors"] = result.errors;
+    }
+    
+    if (!result.digests.empty()) {
+        json digests = json::array();
+        for (const auto& [path, digest] : result.digests) {
+            digests.push_back({{"path", path}, {"digest", digest}});
+        }
+        output["digests"] = std::move(digests);
+    }
+    
+    if (!result.duplicate_groups.empty()) {
+        output["duplicate_groups"] = result.duplicate_groups;
+    }
+    
+    // Add error message if operation failed
+    if (!result.success && !result.error_message.empty()) {
+        output["error_message"] = result.error_message;
+    }
+    return output;
+}
+
+// One response line. Filenames need not be UTF-8; bytes that aren't are
+// replaced rather than thrown over.
+static std::string to_line(const json& output) {
+    return output.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+// One request line of a server connection: the result, or success=false with
+// the reason if the request can't be run
+static std::string handle_request(const std::string& line) {
+    try {
+        auto cmd = parse_command(json::parse(line));
+        if (!actions::validate_command(cmd)) {
+            return to_line({{"success", false}, {"error_message", "Invalid command"}});
+        }
+        return to_line(result_to_json(actions::execute_command(cmd)));
+    } catch (const std::exception& e) {
+        return to_line({{"success", false}, {"error_message", e.what()}});
+    }
+}
+
+// --serve [socket]: answers commands over a Unix socket, keeping worker
+// pools, compiled patterns and directory catalogs warm between them
+static int serve(int argc, char* argv[]) {
+    std::filesystem::path socket_path = argc > 2 ? argv[2] : server::default_socket_path();
+    
+    executor::ExecutorPool executors;
+    server::CatalogRegistry catalogs;
+    actions::Resources resources;
+    resources.executors = &executors;
+    resources.catalogs = [&](const std::filesystem::path& source) { return catalogs.get(source); };
+    actions::set_resources(std::move(resources));
+    
+    std::cerr << "Listening on " << socket_path << std::endl;
+    int err = server::serve(socket_path, handle_request);
+    actions::set_resources({});
+    
+    std::vector<std::string> errors;
+    catalogs.save_all(errors);
+    for (const auto& error : errors) {
+        std::cerr << error << std::endl;
+    }
+    if (err != 0) {
+        std::cerr << "Cannot serve on " << socket_path << ": " << std::strerror(err) << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Paths a command reads or changes, for ordering batch commands
+static std::vector<std::filesystem::path> command_paths(const actions::Command& cmd) {
+    std::vector<std::filesystem::path> paths;
+    for (const auto& path : {cmd.source, cmd.destination}) {
+        if (!path.empty()) paths.push_back(catalog::normalize(utils::expand_path(path)));
+    }
+    return paths;
+}
+
+static bool paths_overlap(const std::filesystem::path& a, const std::filesystem::path& b) {
+    auto within = [](const std::string& inner, const std::string& outer) {
+        return inner.starts_with(outer) &&
+               (inner.size() == outer.size() || outer.back() == '/' || inner[outer.size()] == '/');
+    };
+    return within(a.native(), b.native()) || within(b.native(), a.native());
+}
+
+// --batch [jobs]: one command per stdin line, one result line per command on
+// stdout, in input order. Up to jobs commands run at once; a command whose
+// paths overlap an earlier unfinished one waits for it, so each tree still
+// sees its commands in order, and reuses the directory listings they read.
+static int run_batch(int argc, char* argv[]) {
+    size_t jobs = std::max(2u, std::thread::hardware_concurrency() / 2);
+    if (argc > 2) {
+        try {
+            jobs = std::max<size_t>(std::stoul(argv[2]), 1);
+        } catch (const std::exception&) {
+            std::cerr << "Invalid job count: " << argv[2] << std::endl;
+            return 1;
+        }
+    }
+    
+    executor::ExecutorPool executors(jobs);
+    server::CatalogRegistry catalogs(false);
+    actions::Resources resources;
+    resources.executors = &executors;
+    resources.catalogs = [&](const std::filesystem::path& source) { return catalogs.get(source); };
+    resources.share_listings = true;
+    actions::set_resources(std::move(resources));
+    
+    struct Job {
+        std::vector<std::filesystem::path> paths;
+        std::string response;
+        bool done = false;
+        std::thread thread;
+    };
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::shared_ptr<Job>> window;   // unprinted jobs, in input order
+    size_t running = 0;
+    bool indexed = false;                      // some command asked for --index
+    bool all_succeeded = true;
+    
+    // Prints and reaps finished jobs from the front of the window
+    auto flush = [&] {
+        while (!window.empty() && window.front()->done) {
+            auto& job = window.front();
+            if (job->thread.joinable()) job->thread.join();
+            std::cout << job->response << '\n';
+            window.pop_front();
+        }
+        std::cout.flush();
+    };
+    
+    std::string line;
+    while (std::getline(std::cin, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        
+        auto job = std::make_shared<Job>();
+        std::optional<actions::Command> cmd;
+        try {
+            cmd = parse_command(json::parse(line));
+            if (!actions::validate_command(*cmd)) throw std::invalid_argument("Invalid command");
+            job->paths = command_paths(*cmd);
+        } catch (const std::exception& e) {
+            job->response = to_line({{"success", false}, {"error_message", e.what()}});
+            cmd.reset();
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!cmd) {
+            job->done = true;
+            all_succeeded = false;
+            window.push_back(job);
+            flush();
+            continue;
+        }
+        indexed = indexed || cmd->use_index;
+        auto blocked = [&] {
+            if (running >= jobs || window.size() >= 4 * jobs) return true;
+            for (const auto& earlier : window) {
+                if (earlier->done) continue;
+                for (const auto& a : earlier->paths) {
+                    for (const auto& b : job->paths) {
+                        if (paths_overlap(a, b)) return true;
+                    }
+                }
+            }
+            return false;
+        };
+        flush();
+        while (blocked()) {
+            changed.wait(lock);
+            flush();
+        }
+        running++;
+        window.push_back(job);
+        job->thread = std::thread([&, job, cmd = std::move(*cmd)] {
+            std::string response;
+            bool succeeded = false;
+            try {
+                auto result = actions::execute_command(cmd);
+                response = to_line(result_to_json(result));
+                succeeded = result.success;
+            } catch (const std::exception& e) {
+                response = to_line({{"success", false}, {"error_message", e.what()}});
+            }
+            std::lock_guard<std::mutex> done_lock(mutex);
+            job->response = std::move(response);
+            job->done = true;
+            all_succeeded = all_succeeded && succeeded;
+            running--;
+            changed.notify_all();
+        });
+    }
+    
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return running == 0; });
+        flush();
+    }
+    actions::set_resources({});
+    
+    if (indexed) {
+        std::vector<std::string> errors;
+        catalogs.save_all(errors);
+        for (const auto& error : errors) {
+            std::cerr << error << std::endl;
+        }
+    }
+    return all_succeeded ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && std::string(argv[1]) == "--serve") {
+        return serve(argc, argv);
+    }
+    if (argc > 1 && std::string(argv[1]) == "--batch") {
+        return run_batch(argc, argv);
+    }
+    
     std::string input;
     
     // Read JSON command from stdin
@@ -18,45 +360,14 @@ int main() {
         // Debug: print the parsed JSON to stderr
         std::cerr << "DEBUG: Parsed JSON: " << j.dump(2) << std::endl;
         
-        // Convert JSON to Command struct
-        actions::Command cmd;
-        
         // Debug: check each field to stderr
         std::cerr << "DEBUG: action field: " << (j.contains("action") ? "exists" : "missing") << std::endl;
         if (j.contains("action")) {
             std::cerr << "DEBUG: action value: " << j["action"] << std::endl;
         }
         
-        // Safe assignment with type checking
-        if (j.contains("action") && j["action"].is_string()) {
-            cmd.action = j["action"].get<std::string>();
-        } else {
-            std::cerr << "ERROR: action field is missing or not a string" << std::endl;
-            return 1;
-        }
-        
-        if (j.contains("pattern") && j["pattern"].is_string()) {
-            cmd.pattern = j["pattern"].get<std::string>();
-        } else {
-            cmd.pattern = "";
-        }
-        
-        if (j.contains("source") && j["source"].is_string()) {
-            cmd.source = j["source"].get<std::string>();
-        } else {
-            cmd.source = "";
-        }
-        
-        if (j.contains("destination") && j["destination"].is_string()) {
-            cmd.destination = j["destination"].get<std::string>();
-        } else {
-            cmd.destination = "";
-        }
-        
-        cmd.dry_run = j.value("dry_run", false);
-        cmd.force = j.value("force", false);
-        cmd.recursive = j.value("recursive", false);
-        cmd.verbose = j.value("verbose", false);
+        // Convert JSON to Command struct
+        actions::Command cmd = parse_command(j);
         
         // Debug output to stderr
         std::cerr << "DEBUG: Command struct initialized:" << std::endl;
@@ -86,28 +397,10 @@ int main() {
         auto result = actions::execute_command(cmd);
         
         // Output ONLY the JSON result to stdout (no debug info)
-        json output;
-        output["success"] = result.success;
-        output["operation"] = result.operation;
-        output["message"] = result.message;
-        output["files_scanned"] = result.files_scanned;
-        output["files_matched"] = result.files_matched;
-        output["files_affected"] = result.files_affected;
-        output["start_time"] = std::to_string(result.start_time.time_since_epoch().count());
-        output["end_time"] = std::to_string(result.end_time.time_since_epoch().count());
-        
-        // Add errors if any
-        if (!result.errors.empty()) {
-            output["errors"] = result.errors;
-        }
-        
-        // Add error message if operation failed
-        if (!result.success && !result.error_message.empty()) {
-            output["error_message"] = result.error_message;
-        }
+        json output = result_to_json(result);
         
         // Output ONLY the JSON to stdout
-        std::cout << output.dump() << std::endl;
+        std::cout << to_line(output) << std::endl;
         
         return result.success ? 0 : 1;
         
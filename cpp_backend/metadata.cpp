@@ -0,0 +1,136 @@
+#include "metadata.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
+#include <pwd.h>
+#include <stdexcept>
+
+namespace utils {
+
+namespace {
+
+// Splits "100MB" into 100 and "mb"; false if there's no leading number
+bool split_number(const std::string& text, double& value, std::string& unit) {
+    size_t pos = 0;
+    try {
+        value = std::stod(text, &pos);
+    } catch (const std::exception&) {
+        return false;
+    }
+    if (value < 0 || !std::isfinite(value)) return false;
+
+    unit.clear();
+    for (; pos < text.size(); ++pos) {
+        if (!std::isspace(static_cast<unsigned char>(text[pos]))) {
+            unit.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(text[pos]))));
+        }
+    }
+    return true;
+}
+
+uid_t resolve_owner(const std::string& owner) {
+    if (!owner.empty() && std::all_of(owner.begin(), owner.end(), ::isdigit)) {
+        return static_cast<uid_t>(std::stoul(owner));
+    }
+    struct passwd* pw = getpwnam(owner.c_str());
+    if (!pw) {
+        throw std::invalid_argument("Unknown owner: " + owner);
+    }
+    return pw->pw_uid;
+}
+
+} // namespace
+
+MetadataFilter::MetadataFilter(const MetadataPredicates& predicates)
+    : min_size_(predicates.min_size), max_size_(predicates.max_size), mode_(predicates.mode) {
+    int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    if (predicates.older_than) mtime_before_ = now - *predicates.older_than;
+    if (predicates.newer_than) mtime_after_ = now - *predicates.newer_than;
+    if (!predicates.owner.empty()) uid_ = resolve_owner(predicates.owner);
+
+    if (min_size_ || max_size_) statx_mask_ |= STATX_SIZE;
+    if (mtime_before_ || mtime_after_) statx_mask_ |= STATX_MTIME;
+    if (uid_) statx_mask_ |= STATX_UID;
+    if (mode_) statx_mask_ |= STATX_MODE;
+}
+
+bool MetadataFilter::check(uint64_t size, int64_t mtime, uid_t uid, mode_t mode) const {
+    if (min_size_ && size < *min_size_) return false;
+    if (max_size_ && size > *max_size_) return false;
+    if (mtime_before_ && mtime >= *mtime_before_) return false;
+    if (mtime_after_ && mtime <= *mtime_after_) return false;
+    if (uid_ && uid != *uid_) return false;
+    if (mode_ && (mode & 07777) != *mode_) return false;
+    return true;
+}
+
+bool MetadataFilter::matches(int dir_fd, const char* name, const struct stat* known) const {
+    if (statx_mask_ == 0) return true;
+
+    if (known) {
+        return check(known->st_size, known->st_mtime, known->st_uid, known->st_mode);
+    }
+
+    struct statx stx;
+    if (statx(dir_fd, name, AT_STATX_SYNC_AS_STAT, statx_mask_, &stx) == 0) {
+        // Fields we didn't ask for may be unset, but check() ignores them
+        return check(stx.stx_size, stx.stx_mtime.tv_sec, stx.stx_uid, stx.stx_mode);
+    }
+    if (errno != ENOSYS) {
+        return false;
+    }
+
+    // Kernels older than 4.11 have no statx
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, 0) != 0) {
+        return false;
+    }
+    return check(st.st_size, st.st_mtime, st.st_uid, st.st_mode);
+}
+
+std::optional<uint64_t> parse_size(const std::string& text) {
+    double value;
+    std::string unit;
+    if (!split_number(text, value, unit)) return std::nullopt;
+
+    if (!unit.empty() && unit.back() == 'b') unit.pop_back();
+    if (unit.size() == 2 && unit[1] == 'i') unit.pop_back();   // "KiB" -> "k"
+
+    double scale;
+    if (unit.empty()) scale = 1;
+    else if (unit == "k") scale = 1024.0;
+    else if (unit == "m") scale = 1024.0 * 1024;
+    else if (unit == "g") scale = 1024.0 * 1024 * 1024;
+    else if (unit == "t") scale = 1024.0 * 1024 * 1024 * 1024;
+    else return std::nullopt;
+
+    // Converting a double beyond the integer's range (2^64 here) is undefined
+    double bytes = value * scale;
+    if (bytes >= 0x1p64) return std::nullopt;
+    return static_cast<uint64_t>(bytes);
+}
+
+std::optional<int64_t> parse_duration(const std::string& text) {
+    double value;
+    std::string unit;
+    if (!split_number(text, value, unit)) return std::nullopt;
+
+    double scale;
+    if (unit.empty() || unit == "s") scale = 1;
+    else if (unit == "m" || unit == "min") scale = 60;
+    else if (unit == "h") scale = 3600;
+    else if (unit == "d") scale = 86400;
+    else if (unit == "w") scale = 7 * 86400;
+    else return std::nullopt;
+
+    double seconds = value * scale;
+    if (seconds >= 0x1p63) return std::nullopt;
+    return static_cast<int64_t>(seconds);
+}
+
+} // namespace utils
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+namespace utils {
+
+// Metadata conditions a file must meet in addition to the name pattern
+struct MetadataPredicates {
+    std::optional<uint64_t> min_size;       // bytes, inclusive
+    std::optional<uint64_t> max_size;       // bytes, inclusive
+    std::optional<int64_t> older_than;      // seconds since last modification
+    std::optional<int64_t> newer_than;      // seconds since last modification
+    std::string owner;                      // user name or numeric uid
+    std::optional<unsigned> mode;           // exact permission bits (e.g. 0644)
+
+    bool empty() const {
+        return !min_size && !max_size && !older_than && !newer_than && owner.empty() && !mode;
+    }
+};
+
+// Predicates resolved once per command (owner name -> uid, ages -> cutoffs).
+// Checks run only for files whose name already matched, with a statx call that
+// asks for just the fields the predicates use, or none at all when the scanner
+// already stat'ed the entry.
+class MetadataFilter {
+public:
+    // Throws std::invalid_argument for an unknown owner
+    explicit MetadataFilter(const MetadataPredicates& predicates);
+
+    bool empty() const { return statx_mask_ == 0; }
+
+    // known is an existing stat of the entry (following symlinks), or nullptr
+    bool matches(int dir_fd, const char* name, const struct stat* known) const;
+
+private:
+    bool check(uint64_t size, int64_t mtime, uid_t uid, mode_t mode) const;
+
+    unsigned statx_mask_ = 0;
+    std::optional<uint64_t> min_size_;
+    std::optional<uint64_t> max_size_;
+    std::optional<int64_t> mtime_before_;   // older_than as an absolute cutoff
+    std::optional<int64_t> mtime_after_;    // newer_than as an absolute cutoff
+    std::optional<uid_t> uid_;
+    std::optional<unsigned> mode_;
+};
+
+// "1048576", "100MB", "1.5G", "4KiB" -> bytes (units are powers of 1024)
+std::optional<uint64_t> parse_size(const std::string& text);
+
+// "3600", "30d", "12h", "15m", "2w", "45s" -> seconds
+std::optional<int64_t> parse_duration(const std::string& text);
+
+} // namespace utils
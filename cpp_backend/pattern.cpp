@@ -0,0 +1,525 @@
+#include "pattern.hpp"
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace utils {
+
+namespace {
+
+enum class TokenType { Byte, Star, GlobStar };
+
+struct Token {
+    TokenType type;
+    std::bitset<256> accepts;
+    // "**/" at the start or after a '/': may match nothing, '/' included
+    bool skips_slash = false;
+};
+
+void add_byte(std::bitset<256>& set, unsigned char c, bool case_insensitive) {
+    set.set(c);
+    if (case_insensitive) {
+        set.set(static_cast<unsigned char>(std::tolower(c)));
+        set.set(static_cast<unsigned char>(std::toupper(c)));
+    }
+}
+
+// Parses "[...]" starting at pos (the '['). Returns false if there's no closing ']'.
+bool parse_class(std::string_view pattern, size_t& pos, bool case_insensitive, std::bitset<256>& set) {
+    size_t i = pos + 1;
+    bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negate) i++;
+
+    size_t first = i;
+    std::bitset<256> members;
+    while (i < pattern.size() && (pattern[i] != ']' || i == first)) {
+        unsigned char lo = pattern[i];
+        if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+            unsigned char hi = pattern[i + 2];
+            for (unsigned c = lo; c <= hi; ++c) {
+                add_byte(members, static_cast<unsigned char>(c), case_insensitive);
+            }
+            i += 3;
+        } else {
+            add_byte(members, lo, case_insensitive);
+            i++;
+        }
+    }
+    if (i >= pattern.size()) {
+        return false;
+    }
+
+    set = negate ? ~members : members;
+    set.reset('/');
+    pos = i + 1;
+    return true;
+}
+
+std::vector<Token> tokenize(std::string_view pattern, bool case_insensitive) {
+    std::bitset<256> any_but_slash;
+    any_but_slash.set();
+    any_but_slash.reset('/');
+
+    std::vector<Token> tokens;
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+
+        if (c == '*') {
+            size_t run = 0;
+            while (i < pattern.size() && pattern[i] == '*') {
+                run++;
+                i++;
+            }
+            bool globstar = run >= 2;
+            if (!tokens.empty() && (tokens.back().type == TokenType::Star || tokens.back().type == TokenType::GlobStar)) {
+                // "*" next to "**" is still just "**"
+                if (globstar) tokens.back() = {TokenType::GlobStar, std::bitset<256>().set()};
+            } else if (globstar) {
+                tokens.push_back({TokenType::GlobStar, std::bitset<256>().set()});
+            } else {
+                tokens.push_back({TokenType::Star, any_but_slash});
+            }
+            if (globstar && i < pattern.size() && pattern[i] == '/') {
+                std::bitset<256> slash;
+                slash.set('/');
+                tokens.back().skips_slash = tokens.size() == 1 || tokens[tokens.size() - 2].accepts == slash;
+                tokens.push_back({TokenType::Byte, slash});
+                i++;
+            }
+            continue;
+        }
+
+        Token token{TokenType::Byte, {}};
+        if (c == '?') {
+            token.accepts = any_but_slash;
+            i++;
+        } else if (c == '[' && parse_class(pattern, i, case_insensitive, token.accepts)) {
+            // parse_class advanced i past the ']'
+        } else {
+            add_byte(token.accepts, static_cast<unsigned char>(c), case_insensitive);
+            i++;
+        }
+        tokens.push_back(token);
+    }
+    return tokens;
+}
+
+} // namespace
+
+GlobMatcher::GlobMatcher(std::string_view pattern, bool case_insensitive) : pattern_(pattern) {
+    std::vector<Token> tokens = tokenize(pattern, case_insensitive);
+    if (tokens.size() > kMaxTokens) {
+        throw std::invalid_argument("Glob pattern is too long: " + pattern_);
+    }
+
+    // One state bit per token plus the accepting bit
+    token_count_ = tokens.size();
+    words_ = (token_count_ + 1 + 63) / 64;
+    masks_.assign(256 * words_, 0);
+    loop_.assign(words_, 0);
+    skip_.assign(words_, 0);
+    jump_.assign(words_, 0);
+    start_.assign(words_, 0);
+
+    for (size_t t = 0; t < tokens.size(); ++t) {
+        size_t word = t / 64;
+        uint64_t bit = uint64_t{1} << (t % 64);
+        for (unsigned c = 0; c < 256; ++c) {
+            if (tokens[t].accepts.test(c)) masks_[c * words_ + word] |= bit;
+        }
+        if (tokens[t].type == TokenType::Star || tokens[t].type == TokenType::GlobStar) {
+            loop_[word] |= bit;
+            skip_[word] |= bit;
+        }
+        if (tokens[t].skips_slash) jump_[word] |= bit;
+    }
+
+    start_[0] = 1;
+    if (words_ == 1) {
+        uint64_t fresh = start_[0];
+        close_single(start_[0], fresh);
+    } else {
+        std::vector<uint64_t> fresh = start_;
+        close_multi(start_.data(), fresh.data());
+    }
+}
+
+// Follows epsilon edges: past skippable tokens (at most a few in a row), and
+// past a "**/" together with its '/' when it is entered at this byte. fresh
+// holds the states entered at this byte, as opposed to kept by a '*' loop.
+void GlobMatcher::close_single(uint64_t& state, uint64_t fresh) const {
+    for (;;) {
+        uint64_t add = ((state & skip_[0]) << 1) | ((fresh & jump_[0]) << 2);
+        if ((add & ~fresh) == 0) return;
+        fresh |= add;
+        state |= add;
+    }
+}
+
+void GlobMatcher::close_multi(uint64_t* state, uint64_t* fresh) const {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        uint64_t carry = 0;
+        uint64_t jump_carry = 0;
+        for (size_t w = 0; w < words_; ++w) {
+            uint64_t skippable = state[w] & skip_[w];
+            uint64_t jumping = fresh[w] & jump_[w];
+            uint64_t add = (skippable << 1) | carry | (jumping << 2) | jump_carry;
+            carry = skippable >> 63;
+            jump_carry = jumping >> 62;
+            if (add & ~fresh[w]) {
+                fresh[w] |= add;
+                state[w] |= add;
+                changed = true;
+            }
+        }
+    }
+}
+
+bool GlobMatcher::matches(std::string_view text) const {
+    if (words_ != 1) {
+        return matches_multi(text);
+    }
+
+    const uint64_t loop = loop_[0];
+    uint64_t state = start_[0];
+    for (unsigned char c : text) {
+        uint64_t live = state & masks_[c];
+        uint64_t fresh = (live & ~loop) << 1;
+        state = fresh | (live & loop);
+        if (state == 0) return false;
+        close_single(state, fresh);
+    }
+    return (state >> token_count_) & 1;
+}
+
+bool GlobMatcher::may_match_with_prefix(std::string_view prefix) const {
+    if (words_ != 1) {
+        uint64_t state[kMaxWords];
+        return run_multi(prefix, state);
+    }
+
+    const uint64_t loop = loop_[0];
+    uint64_t state = start_[0];
+    for (unsigned char c : prefix) {
+        uint64_t live = state & masks_[c];
+        uint64_t fresh = (live & ~loop) << 1;
+        state = fresh | (live & loop);
+        if (state == 0) return false;
+        close_single(state, fresh);
+    }
+    return true;
+}
+
+bool GlobMatcher::matches_multi(std::string_view text) const {
+    uint64_t state[kMaxWords];
+    if (!run_multi(text, state)) return false;
+    return (state[token_count_ / 64] >> (token_count_ % 64)) & 1;
+}
+
+// Runs the multi-word NFA over text; false as soon as no state is live
+bool GlobMatcher::run_multi(std::string_view text, uint64_t* state) const {
+    for (size_t w = 0; w < words_; ++w) state[w] = start_[w];
+
+    uint64_t fresh[kMaxWords];
+    for (unsigned char c : text) {
+        uint64_t carry = 0;
+        uint64_t any = 0;
+        for (size_t w = 0; w < words_; ++w) {
+            uint64_t live = state[w] & mask(c, w);
+            uint64_t advance = live & ~loop_[w];
+            fresh[w] = (advance << 1) | carry;
+            state[w] = fresh[w] | (live & loop_[w]);
+            carry = advance >> 63;
+            any |= state[w];
+        }
+        if (any == 0) return false;
+        close_multi(state, fresh);
+    }
+    return true;
+}
+
+bool is_glob_pattern(std::string_view pattern) {
+    if (pattern.find_first_of("*?") != std::string_view::npos) {
+        return true;
+    }
+    size_t open = pattern.find('[');
+    return open != std::string_view::npos && pattern.find(']', open + 2) != std::string_view::npos;
+}
+
+namespace {
+
+constexpr uint64_t kOnes = 0x0101010101010101ULL;
+constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+
+// ASCII-lowercases all eight bytes at once; non-ASCII bytes are left alone
+inline uint64_t fold_ascii_case(uint64_t word) {
+    uint64_t low7 = word & ~kHighBits;
+    uint64_t at_least_a = low7 + (0x80 - 'A') * kOnes;
+    uint64_t above_z = low7 + (0x80 - 'Z' - 1) * kOnes;
+    uint64_t upper = at_least_a & ~above_z & ~word & kHighBits;
+    return word | (upper >> 2);
+}
+
+// Last min(size, 8) bytes of name, little-endian, with the final byte in the top
+// byte of the word. Shifting right by 8 * (8 - L) leaves exactly the last L bytes.
+inline uint64_t load_tail(std::string_view name) {
+    uint64_t word = 0;
+    if (name.size() >= 8) {
+        std::memcpy(&word, name.data() + name.size() - 8, 8);
+    } else {
+        unsigned char bytes[8] = {};
+        std::memcpy(bytes + 8 - name.size(), name.data(), name.size());
+        std::memcpy(&word, bytes, 8);
+    }
+    return fold_ascii_case(word);
+}
+
+uint64_t pack_suffix(std::string_view suffix) {
+    uint64_t key = 0;
+    for (size_t i = 0; i < suffix.size(); ++i) {
+        key |= uint64_t{static_cast<unsigned char>(std::tolower(static_cast<unsigned char>(suffix[i])))} << (8 * i);
+    }
+    return key;
+}
+
+uint64_t splitmix64(uint64_t& seed) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+bool ends_with_ignore_case(std::string_view name, std::string_view lower_suffix) {
+    if (name.size() < lower_suffix.size()) return false;
+    name.remove_prefix(name.size() - lower_suffix.size());
+    for (size_t i = 0; i < name.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(name[i])) != static_cast<unsigned char>(lower_suffix[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::string_view> split_list(std::string_view list) {
+    std::vector<std::string_view> items;
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (!item.empty()) items.push_back(item);
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
+    }
+    return items;
+}
+
+// What follows the last '.' of a literal name suffix, lowercased; empty if
+// the suffix doesn't fix it
+std::string final_extension(std::string_view suffix) {
+    size_t dot = suffix.rfind('.');
+    if (dot == std::string_view::npos || dot + 1 == suffix.size()) return {};
+    std::string extension(suffix.substr(dot + 1));
+    if (extension.find('/') != std::string::npos) return {};
+    for (char& c : extension) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return extension;
+}
+
+} // namespace
+
+ExtensionSet::ExtensionSet(std::string_view list) {
+    std::vector<uint64_t> keys;
+    bool has_length[9] = {};
+    for (std::string_view suffix : split_list(list)) {
+        if (suffix.size() <= 8) {
+            keys.push_back(pack_suffix(suffix));
+            has_length[suffix.size()] = true;
+        } else {
+            std::string lower(suffix);
+            for (auto& c : lower) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            long_suffixes_.push_back(std::move(lower));
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    key_count_ = keys.size();
+
+    for (uint8_t len = 1; len <= 8; ++len) {
+        if (has_length[len]) lengths_[length_count_++] = len;
+    }
+
+    // Search for a multiplier that maps every key to its own slot. With a table
+    // at least twice the key count this takes a handful of tries.
+    unsigned bits = 1;
+    while ((size_t{1} << bits) < keys.size() * 2) bits++;
+    uint64_t seed = 0x5eed;
+    for (;; ++bits) {
+        size_t slots = size_t{1} << bits;
+        for (int attempt = 0; attempt < 256; ++attempt) {
+            uint64_t multiplier = splitmix64(seed) | 1;
+            std::vector<uint64_t> table(slots, 0);
+            bool collision = false;
+            for (uint64_t key : keys) {
+                uint64_t& slot = table[(key * multiplier) >> (64 - bits)];
+                if (slot != 0) {
+                    collision = true;
+                    break;
+                }
+                slot = key;
+            }
+            if (!collision) {
+                table_ = std::move(table);
+                multiplier_ = multiplier;
+                shift_ = 64 - bits;
+                return;
+            }
+        }
+    }
+}
+
+bool ExtensionSet::matches(std::string_view name) const {
+    uint64_t tail = load_tail(name);
+    for (size_t i = 0; i < length_count_; ++i) {
+        size_t len = lengths_[i];
+        if (len > name.size()) break;
+        if (lookup(tail >> (64 - 8 * len))) return true;
+    }
+    for (const auto& suffix : long_suffixes_) {
+        if (ends_with_ignore_case(name, suffix)) return true;
+    }
+    return false;
+}
+
+void ExtensionSet::match_batch(std::span<const scanner::DirEntry> batch, uint8_t* out) const {
+    // Fast path: no long suffixes, so each name is one load plus length_count_ probes
+    if (long_suffixes_.empty()) {
+        for (size_t n = 0; n < batch.size(); ++n) {
+            std::string_view name = batch[n].name;
+            uint64_t tail = load_tail(name);
+            uint8_t hit = 0;
+            for (size_t i = 0; i < length_count_; ++i) {
+                size_t len = lengths_[i];
+                hit |= static_cast<uint8_t>(len <= name.size() && lookup(tail >> (64 - 8 * len)));
+            }
+            out[n] = hit;
+        }
+        return;
+    }
+    for (size_t n = 0; n < batch.size(); ++n) {
+        out[n] = matches(batch[n].name);
+    }
+}
+
+bool is_extension_list(std::string_view pattern) {
+    auto items = split_list(pattern);
+    if (items.empty()) return false;
+    for (std::string_view item : items) {
+        if (item.size() < 2 || item[0] != '.' || is_glob_pattern(item)) return false;
+    }
+    return true;
+}
+
+PatternMatcher::PatternMatcher(const std::string& pattern) : pattern_(pattern) {
+    if (pattern.empty()) {
+        kind_ = Kind::All;
+    } else if (is_glob_pattern(pattern)) {
+        kind_ = Kind::Glob;
+        std::string_view glob = pattern;
+        if (glob.starts_with("./")) glob.remove_prefix(2);
+        path_pattern_ = glob.find('/') != std::string_view::npos;
+        glob_.emplace(glob);
+        // The literal text after the last wildcard ends every match
+        std::string extension = final_extension(glob.substr(glob.find_last_of("*?]") + 1));
+        if (!extension.empty()) final_extensions_.push_back(std::move(extension));
+    } else if (is_extension_list(pattern)) {
+        kind_ = Kind::Extensions;
+        extensions_.emplace(pattern);
+        for (std::string_view suffix : split_list(pattern)) {
+            std::string extension = final_extension(suffix);
+            if (extension.empty()) {
+                final_extensions_.clear();   // one unpinned suffix can match anything
+                break;
+            }
+            final_extensions_.push_back(std::move(extension));
+        }
+    } else {
+        kind_ = Kind::Exact;
+        std::string extension = final_extension(pattern);
+        if (!extension.empty()) final_extensions_.push_back(std::move(extension));
+    }
+}
+
+bool PatternMatcher::matches(std::string_view filename) const {
+    switch (kind_) {
+        case Kind::All:
+            return true;
+        case Kind::Extensions:
+            return extensions_->matches(filename);
+        case Kind::Glob:
+            return glob_->matches(filename);
+        case Kind::Exact:
+            return filename == pattern_;
+    }
+    return false;
+}
+
+void PatternMatcher::match_batch(std::span<const scanner::DirEntry> batch, const std::string& dir_rel,
+                                 uint8_t* out) const {
+    if (path_pattern_) {
+        // Reuse one buffer per thread for "dir_rel/name"
+        thread_local std::string path;
+        path.assign(dir_rel);
+        if (!path.empty()) path.push_back('/');
+        size_t prefix = path.size();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            path.resize(prefix);
+            path.append(batch[i].name);
+            out[i] = glob_->matches(path);
+        }
+        return;
+    }
+
+    switch (kind_) {
+        case Kind::All:
+            std::fill(out, out + batch.size(), uint8_t{1});
+            return;
+        case Kind::Extensions:
+            extensions_->match_batch(batch, out);
+            return;
+        default:
+            for (size_t i = 0; i < batch.size(); ++i) {
+                out[i] = matches(batch[i].name);
+            }
+            return;
+    }
+}
+
+bool PatternMatcher::may_match_under(const std::string& dir_rel) const {
+    if (!path_pattern_) return true;
+    return glob_->may_match_with_prefix(dir_rel + "/");
+}
+
+std::shared_ptr<const PatternMatcher> compile_pattern(const std::string& pattern) {
+    constexpr size_t kCapacity = 64;
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::shared_ptr<const PatternMatcher>> compiled;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto it = compiled.find(pattern); it != compiled.end()) return it->second;
+    }
+    auto matcher = std::make_shared<const PatternMatcher>(pattern);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (compiled.size() >= kCapacity) compiled.clear();   // patterns repeat; rebuilding is cheap
+    compiled.emplace(pattern, matcher);
+    return matcher;
+}
+
+} // namespace utils
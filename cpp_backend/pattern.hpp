@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "scanner.hpp"
+
+namespace utils {
+
+// Glob compiled once into a bit-parallel NFA: bit i of the state means "the first
+// i tokens have matched". Each input byte costs a table lookup and a few shifts per
+// 64 tokens, so matching is linear in the name length and never allocates.
+//
+// Supported syntax: '*' (anything but '/'), '?' (one byte but '/'), '[abc]',
+// '[a-z]', '[!x]' / '[^x]', and '**' (anything, including '/'). "**/" also matches
+// zero directories, so "src/**/*.o" matches "src/main.o".
+class GlobMatcher {
+public:
+    static constexpr size_t kMaxTokens = 1023;
+
+    // Throws std::invalid_argument if the pattern has more than kMaxTokens tokens
+    explicit GlobMatcher(std::string_view pattern, bool case_insensitive = true);
+
+    bool matches(std::string_view text) const;
+
+    // False if no text starting with prefix can match, which lets a path walk
+    // skip a directory without opening it (prefix = "dir/sub/")
+    bool may_match_with_prefix(std::string_view prefix) const;
+
+    const std::string& pattern() const { return pattern_; }
+
+private:
+    static constexpr size_t kMaxWords = (kMaxTokens + 1 + 63) / 64;
+
+    uint64_t mask(unsigned char c, size_t word) const { return masks_[c * words_ + word]; }
+    void close_single(uint64_t& state, uint64_t fresh) const;
+    void close_multi(uint64_t* state, uint64_t* fresh) const;
+    bool matches_multi(std::string_view text) const;
+    bool run_multi(std::string_view text, uint64_t* state) const;
+
+    std::string pattern_;
+    size_t words_ = 1;
+    size_t token_count_ = 0;
+    std::vector<uint64_t> masks_;     // [byte][word]: tokens that accept this byte
+    std::vector<uint64_t> loop_;      // tokens that may repeat ('*', '**')
+    std::vector<uint64_t> skip_;      // tokens that may match nothing ('*', '**')
+    std::vector<uint64_t> jump_;      // '**' that may also skip the '/' after it
+    std::vector<uint64_t> start_;     // initial state after epsilon closure
+};
+
+// Case-insensitive set of filename suffixes such as ".jpg,.jpeg,.PNG". The last
+// (up to) eight bytes of a name are loaded as one integer, ASCII-lowercased with
+// SWAR arithmetic, and each distinct suffix length is checked against a perfect
+// hash table with a single compare. Suffixes longer than eight bytes fall back to
+// a string comparison.
+class ExtensionSet {
+public:
+    explicit ExtensionSet(std::string_view list);
+
+    bool matches(std::string_view name) const;
+
+    // Batched kernel over a scanner batch: out[i] = 1 if batch[i] matches
+    void match_batch(std::span<const scanner::DirEntry> batch, uint8_t* out) const;
+
+    size_t size() const { return key_count_ + long_suffixes_.size(); }
+
+private:
+    bool lookup(uint64_t key) const {
+        return table_[(key * multiplier_) >> shift_] == key;
+    }
+
+    std::vector<uint64_t> table_;     // perfect hash of packed suffixes, 0 = empty
+    uint64_t multiplier_ = 0;
+    unsigned shift_ = 63;
+    uint8_t lengths_[8] = {};         // distinct packed suffix lengths, ascending
+    size_t length_count_ = 0;
+    size_t key_count_ = 0;
+    std::vector<std::string> long_suffixes_;   // lowercased, longer than 8 bytes
+};
+
+// A command's pattern compiled once: empty (match all), ".ext" suffix or a
+// comma-separated suffix list (case-insensitive), glob, or exact filename.
+// Globs containing '/' are path patterns: they match the path relative to the
+// scan root ("src/**/build/*.o") instead of the bare filename.
+class PatternMatcher {
+public:
+    explicit PatternMatcher(const std::string& pattern);
+
+    // filename for name patterns, root-relative path for path patterns
+    bool matches(std::string_view filename) const;
+
+    // Matches a whole scanner batch from the directory at dir_rel (relative to the
+    // scan root): out[i] = 1 if batch[i] matches
+    void match_batch(std::span<const scanner::DirEntry> batch, const std::string& dir_rel,
+                     uint8_t* out) const;
+
+    bool is_path_pattern() const { return path_pattern_; }
+
+    // False if nothing under the directory at dir_rel can match (path patterns only)
+    bool may_match_under(const std::string& dir_rel) const;
+
+    // Lowercased final extensions ("psd" for ".psd", "gz" for "*.tar.gz"), one
+    // of which every matching name ends in; empty if the pattern pins none
+    const std::vector<std::string>& final_extensions() const { return final_extensions_; }
+
+private:
+    enum class Kind { All, Extensions, Glob, Exact };
+
+    Kind kind_ = Kind::All;
+    bool path_pattern_ = false;
+    std::string pattern_;
+    std::optional<GlobMatcher> glob_;
+    std::optional<ExtensionSet> extensions_;
+    std::vector<std::string> final_extensions_;
+};
+
+// The matcher for pattern, shared with recent callers that compiled the same
+// one; saves a long-running process from rebuilding it for every command.
+// Throws like the constructor.
+std::shared_ptr<const PatternMatcher> compile_pattern(const std::string& pattern);
+
+// True for a suffix pattern: ".ext" or a list like ".jpg,.png"
+bool is_extension_list(std::string_view pattern);
+
+// True if the pattern uses glob syntax ('*', '?' or a closed '[...]')
+bool is_glob_pattern(std::string_view pattern);
+
+} // namespace utils
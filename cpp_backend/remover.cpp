@@ -0,0 +1,190 @@
+#include "remover.hpp"
+#include "executor.hpp"
+#include "scanner.hpp"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace remover {
+
+namespace {
+
+struct Node {
+    std::shared_ptr<Node> parent;
+    std::string name;                 // entry name in parent, full path for roots
+    std::filesystem::path path;       // for messages
+    int fd = -1;                      // open while its children are being removed
+    std::atomic<size_t> pending{1};   // subdirectories not yet removed + its own scan
+    std::atomic<bool> failed{false};  // something below it is still there
+};
+
+class TreeRemoval {
+public:
+    explicit TreeRemoval(size_t threads)
+        : threads_(threads > 0 ? threads : executor::default_thread_count()) {}
+
+    RemoveStats run(const std::vector<std::filesystem::path>& roots) {
+        for (const auto& root : roots) {
+            auto node = std::make_shared<Node>();
+            node->name = root.string();
+            node->path = root;
+            push(std::move(node));
+        }
+
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < threads_; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        RemoveStats stats;
+        stats.files = files_.load();
+        stats.directories = directories_.load();
+        stats.errors = std::move(errors_);
+        return stats;
+    }
+
+private:
+    void push(std::shared_ptr<Node> node) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(node));
+        outstanding_++;
+        ready_.notify_one();
+    }
+
+    void work() {
+        scanner::DirectoryReader reader;
+        for (;;) {
+            std::shared_ptr<Node> node;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ready_.wait(lock, [&] { return !queue_.empty() || outstanding_ == 0; });
+                if (queue_.empty()) return;
+                // Newest first keeps the walk depth-first, so few directories stay open
+                node = std::move(queue_.back());
+                queue_.pop_back();
+            }
+
+            empty_directory(reader, node);
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--outstanding_ == 0) ready_.notify_all();
+        }
+    }
+
+    void empty_directory(scanner::DirectoryReader& reader, const std::shared_ptr<Node>& node) {
+        // Never through a symlink, roots included: one swapped in for a
+        // directory since it was found is removed itself, not emptied
+        int parent_fd = node->parent ? node->parent->fd : AT_FDCWD;
+        node->fd = scanner::open_directory_at(parent_fd, node->name.c_str());
+        if (node->fd < 0 && (errno == ELOOP || errno == ENOTDIR)) {
+            if (unlinkat(parent_fd, node->name.c_str(), 0) == 0) {
+                files_.fetch_add(1, std::memory_order_relaxed);
+            } else if (errno != ENOENT) {
+                fail(*node, errno);
+            }
+            finish(node, false);
+            return;
+        }
+        if (node->fd < 0) {
+            // Already gone is as good as removed
+            bool gone = errno == ENOENT;
+            if (!gone) fail(*node, errno);
+            finish(node, !gone);
+            return;
+        }
+
+        int err = reader.read(node->fd, [&](std::span<scanner::DirEntry> batch) {
+            for (const auto& entry : batch) {
+                auto type = entry.type;
+                if (type == scanner::EntryType::Unknown) {
+                    type = scanner::stat_type(node->fd, entry.name.data(), false);
+                }
+                if (type == scanner::EntryType::Directory) {
+                    auto child = std::make_shared<Node>();
+                    child->parent = node;
+                    child->name = std::string(entry.name);
+                    child->path = node->path / entry.name;
+                    node->pending.fetch_add(1, std::memory_order_relaxed);
+                    push(std::move(child));
+                } else if (unlinkat(node->fd, entry.name.data(), 0) == 0) {
+                    files_.fetch_add(1, std::memory_order_relaxed);
+                } else if (errno != ENOENT) {
+                    fail_entry(*node, entry.name, errno);
+                }
+            }
+        });
+        if (err != 0) fail(*node, err);
+        finish(node, true);
+    }
+
+    // Drops one reference from node's count; whoever reaches zero removes the
+    // directory and continues with its parent
+    void finish(std::shared_ptr<Node> node, bool remove) {
+        while (node && node->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (node->fd >= 0) {
+                close(node->fd);
+                node->fd = -1;
+            }
+
+            auto parent = node->parent;
+            int parent_fd = parent ? parent->fd : AT_FDCWD;
+            if (node->failed.load(std::memory_order_acquire)) {
+                // Not empty; the cause was reported further down
+                if (parent) parent->failed.store(true, std::memory_order_release);
+            } else if (remove) {
+                if (unlinkat(parent_fd, node->name.c_str(), AT_REMOVEDIR) == 0) {
+                    directories_.fetch_add(1, std::memory_order_relaxed);
+                } else if (errno != ENOENT) {
+                    fail(*node, errno);
+                    if (parent) parent->failed.store(true, std::memory_order_release);
+                }
+            }
+            node = std::move(parent);
+            remove = true;
+        }
+    }
+
+    void fail(Node& node, int err) {
+        node.failed.store(true, std::memory_order_release);
+        record("Failed to remove " + node.path.string() + ": " + std::strerror(err));
+    }
+
+    void fail_entry(Node& node, std::string_view name, int err) {
+        node.failed.store(true, std::memory_order_release);
+        record("Failed to remove " + (node.path / name).string() + ": " + std::strerror(err));
+    }
+
+    void record(std::string message) {
+        std::lock_guard<std::mutex> lock(errors_mutex_);
+        errors_.push_back(std::move(message));
+    }
+
+    const size_t threads_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::vector<std::shared_ptr<Node>> queue_;
+    size_t outstanding_ = 0;          // queued or being scanned
+
+    std::atomic<size_t> files_{0};
+    std::atomic<size_t> directories_{0};
+    std::mutex errors_mutex_;
+    std::vector<std::string> errors_;
+};
+
+} // namespace
+
+RemoveStats remove_trees(const std::vector<std::filesystem::path>& roots, size_t threads) {
+    TreeRemoval removal(threads);
+    return removal.run(roots);
+}
+
+} // namespace remover
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace remover {
+
+struct RemoveStats {
+    size_t files = 0;             // non-directory entries unlinked
+    size_t directories = 0;       // directories removed, roots included
+    std::vector<std::string> errors;
+};
+
+// Removes each root and everything below it. Workers (0 = I/O default) scan
+// directories in parallel and unlink every non-directory entry as soon as it
+// is read. Each directory keeps an atomic count of subdirectories still being
+// torn down; the worker that brings it to zero rmdirs it and moves on to its
+// parent, so removal runs bottom-up without a serial post-order pass. Symlinks
+// are removed, never followed, even where a root was. A directory that can't be emptied is reported
+// once and its ancestors are left in place.
+RemoveStats remove_trees(const std::vector<std::filesystem::path>& roots, size_t threads = 0);
+
+} // namespace remover
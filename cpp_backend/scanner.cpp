@@ -0,0 +1,373 @@
+#include "scanner.hpp"
+#include "ignore.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace scanner {
+
+namespace {
+
+EntryType type_from_dtype(unsigned char d_type) {
+    switch (d_type) {
+        case DT_REG: return EntryType::Regular;
+        case DT_DIR: return EntryType::Directory;
+        case DT_LNK: return EntryType::Symlink;
+        case DT_UNKNOWN: return EntryType::Unknown;
+        default: return EntryType::Other;
+    }
+}
+
+EntryType type_from_mode(mode_t mode) {
+    if (S_ISREG(mode)) return EntryType::Regular;
+    if (S_ISDIR(mode)) return EntryType::Directory;
+    if (S_ISLNK(mode)) return EntryType::Symlink;
+    return EntryType::Other;
+}
+
+bool is_dot_or_dotdot(const char* name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+#ifdef __linux__
+// Kernel layout of a getdents64 record
+struct linux_dirent64 {
+    ino64_t d_ino;
+    off64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+} // namespace
+
+DirectoryReader::DirectoryReader(size_t buffer_size) : buffer_(buffer_size) {
+    // Roughly one entry per 32 bytes of buffer for typical name lengths
+    batch_.reserve(buffer_size / 32);
+}
+
+#ifdef __linux__
+
+int DirectoryReader::read(int dir_fd, const std::function<void(std::span<DirEntry>)>& visit) {
+    for (;;) {
+        long nread = syscall(SYS_getdents64, dir_fd, buffer_.data(), buffer_.size());
+        if (nread < 0) {
+            if (errno == EINTR) continue;
+            return errno;
+        }
+        if (nread == 0) {
+            return 0;
+        }
+
+        batch_.clear();
+        for (long offset = 0; offset < nread;) {
+            auto* record = reinterpret_cast<linux_dirent64*>(buffer_.data() + offset);
+            offset += record->d_reclen;
+
+            if (is_dot_or_dotdot(record->d_name)) continue;
+            batch_.push_back({std::string_view(record->d_name), type_from_dtype(record->d_type)});
+        }
+
+        if (!batch_.empty()) {
+            visit(std::span<DirEntry>(batch_));
+        }
+    }
+}
+
+#else
+
+int DirectoryReader::read(int dir_fd, const std::function<void(std::span<DirEntry>)>& visit) {
+    // Portable fallback: readdir on a duplicate so fdopendir doesn't take ownership
+    int dup_fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (dup_fd < 0) return errno;
+
+    DIR* dir = fdopendir(dup_fd);
+    if (!dir) {
+        int err = errno;
+        close(dup_fd);
+        return err;
+    }
+
+    // Names are copied into buffer_ so a batch stays valid across readdir calls
+    size_t used = 0;
+    batch_.clear();
+    errno = 0;
+    while (struct dirent* ent = readdir(dir)) {
+        if (is_dot_or_dotdot(ent->d_name)) continue;
+
+        size_t len = std::char_traits<char>::length(ent->d_name);
+        if (used + len + 1 > buffer_.size()) {
+            visit(std::span<DirEntry>(batch_));
+            batch_.clear();
+            used = 0;
+        }
+        std::copy(ent->d_name, ent->d_name + len + 1, buffer_.data() + used);
+        batch_.push_back({std::string_view(buffer_.data() + used, len), type_from_dtype(ent->d_type)});
+        used += len + 1;
+    }
+    int err = errno;
+    if (!batch_.empty()) {
+        visit(std::span<DirEntry>(batch_));
+    }
+    closedir(dir);
+    return err;
+}
+
+#endif
+
+int open_directory(const std::filesystem::path& path) {
+    return open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+int open_directory_at(int parent_fd, const char* name) {
+    return openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+}
+
+EntryType stat_type(int dir_fd, const char* name, bool follow_symlinks) {
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, follow_symlinks ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        return EntryType::Unknown;
+    }
+    return type_from_mode(st.st_mode);
+}
+
+bool is_regular_file(int dir_fd, const DirEntry& entry) {
+    switch (entry.type) {
+        case EntryType::Regular:
+            return true;
+        case EntryType::Unknown:
+        case EntryType::Symlink:
+            return stat_type(dir_fd, entry.name.data(), true) == EntryType::Regular;
+        default:
+            return false;
+    }
+}
+
+FileDescriptor::~FileDescriptor() {
+    if (fd_ >= 0) close(fd_);
+}
+
+size_t resolve_thread_count(size_t requested) {
+    if (requested > 0) return requested;
+    size_t hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+namespace {
+
+// Directories held open by queued batches and tasks easily exceed the usual
+// soft limit of 1024 descriptors
+void raise_descriptor_limit() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        struct rlimit limit;
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+    });
+}
+
+struct WalkWorker {
+    std::mutex mutex;
+    std::deque<std::shared_ptr<const Directory>> pending;
+    std::vector<std::string> errors;
+    std::vector<struct stat> stats;     // backing store for DirEntry::stat
+};
+
+class Walk {
+public:
+    Walk(const WalkOptions& options, const WalkVisitor& visit)
+        : options_(options), visit_(visit), workers_(resolve_thread_count(options.threads)) {}
+
+    std::vector<std::string> run(const std::filesystem::path& root) {
+        push(0, std::make_shared<Directory>(Directory{root, "", options_.ignore}));
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < workers_.size(); ++i) {
+            threads.emplace_back([this, i] { work(i); });
+        }
+        work(0);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        // Each worker collected its own errors; merge once everyone is done
+        std::vector<std::string> errors;
+        for (auto& worker : workers_) {
+            errors.insert(errors.end(), worker.errors.begin(), worker.errors.end());
+        }
+        return errors;
+    }
+
+private:
+    void push(size_t index, std::shared_ptr<const Directory> dir) {
+        outstanding_.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(workers_[index].mutex);
+        workers_[index].pending.push_back(std::move(dir));
+    }
+
+    std::shared_ptr<const Directory> pop(size_t index) {
+        {
+            auto& own = workers_[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.pending.empty()) {
+                auto dir = std::move(own.pending.back());
+                own.pending.pop_back();
+                return dir;
+            }
+        }
+
+        // Steal the oldest (usually shallowest, so largest) directory from a peer
+        for (size_t offset = 1; offset < workers_.size(); ++offset) {
+            auto& victim = workers_[(index + offset) % workers_.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.pending.empty()) {
+                auto dir = std::move(victim.pending.front());
+                victim.pending.pop_front();
+                return dir;
+            }
+        }
+        return nullptr;
+    }
+
+    void work(size_t index) {
+        DirectoryReader reader;
+        unsigned idle_spins = 0;
+
+        while (outstanding_.load(std::memory_order_acquire) > 0) {
+            auto dir = pop(index);
+            if (!dir) {
+                // Someone is still reading a directory that may produce more work
+                if (++idle_spins < 64) {
+                    std::this_thread::yield();
+                } else {
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+                continue;
+            }
+            idle_spins = 0;
+
+            process(index, reader, dir);
+            outstanding_.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void process(size_t index, DirectoryReader& reader, std::shared_ptr<const Directory> shared_dir) {
+        // Relative to the open parent the kernel walks one component, not the whole path
+        int dir_fd = shared_dir->parent && shared_dir->parent->fd
+                         ? open_directory_at(shared_dir->parent->dir_fd(), shared_dir->path.filename().c_str())
+                         : open_directory(shared_dir->path);
+        if (dir_fd < 0) {
+            record_error(index, *shared_dir, errno);
+            return;
+        }
+
+        // An ignore file here adds rules for this directory's entries and subtree
+        auto rules = shared_dir->ignore;
+        if (!options_.ignore_files.empty()) {
+            std::vector<std::string> rule_errors;
+            rules = utils::IgnoreList::load(dir_fd, options_.ignore_files, shared_dir->ignore, shared_dir->rel,
+                                            rule_errors);
+            for (const auto& error : rule_errors) {
+                workers_[index].errors.push_back("Ignore file " + (shared_dir->path / error).string());
+            }
+        }
+        if (options_.keep_open || rules != shared_dir->ignore) {
+            auto updated = std::make_shared<Directory>(*shared_dir);
+            updated->ignore = std::move(rules);
+            if (options_.keep_open) {
+                updated->fd = std::make_shared<const FileDescriptor>(dir_fd);
+            }
+            shared_dir = std::move(updated);
+        }
+        const Directory& dir = *shared_dir;
+
+        auto& stats = workers_[index].stats;
+        auto handle = [&](std::span<DirEntry> batch) {
+            stats.resize(batch.size());
+            for (size_t i = 0; i < batch.size(); ++i) {
+                auto& entry = batch[i];
+                if (entry.type == EntryType::Unknown &&
+                    fstatat(dir_fd, entry.name.data(), &stats[i], AT_SYMLINK_NOFOLLOW) == 0) {
+                    // Keep the result so metadata checks downstream don't stat again
+                    entry.type = type_from_mode(stats[i].st_mode);
+                    entry.stat = &stats[i];
+                }
+                if (options_.recursive && entry.type == EntryType::Directory) {
+                    if (dir.ignore && dir.ignore->ignored(dir.rel, entry.name, true)) {
+                        continue;
+                    }
+                    std::string rel = dir.rel.empty() ? std::string(entry.name)
+                                                      : dir.rel + "/" + std::string(entry.name);
+                    if (options_.descend && !options_.descend(dir, entry.name, rel)) {
+                        continue;
+                    }
+                    auto child = std::make_shared<Directory>(Directory{dir.path / entry.name, std::move(rel), dir.ignore});
+                    if (options_.keep_open) {
+                        child->parent = shared_dir;
+                    }
+                    push(index, std::move(child));
+                }
+            }
+            visit_(index, dir_fd, shared_dir, batch);
+        };
+
+        // A cached listing that is still valid spares the getdents and lstat calls
+        struct stat dir_st;
+        ListingCache* cache = options_.cache && fstat(dir_fd, &dir_st) == 0 ? options_.cache : nullptr;
+        int err = 0;
+        if (!cache || !cache->lookup(dir.path, dir_st, handle)) {
+            err = reader.read(dir_fd, [&](std::span<DirEntry> batch) {
+                handle(batch);
+                if (cache) cache->store(dir.path, dir_st, dir_fd, batch);
+            });
+            if (cache && err == 0) cache->store(dir.path, dir_st, dir_fd, {});
+            if (cache && err != 0) cache->discard(dir.path, dir_fd);
+        }
+        if (err != 0) {
+            record_error(index, dir, err);
+        }
+        if (!options_.keep_open) {
+            close(dir_fd);
+        }
+    }
+
+    void record_error(size_t index, const Directory& dir, int err) {
+        workers_[index].errors.push_back("Failed to read directory " + dir.path.string() + ": " + std::strerror(err));
+    }
+
+    const WalkOptions& options_;
+    const WalkVisitor& visit_;
+    std::vector<WalkWorker> workers_;
+    std::atomic<size_t> outstanding_{0};
+};
+
+} // namespace
+
+std::vector<std::string> walk(const std::filesystem::path& root, const WalkOptions& options,
+                              const WalkVisitor& visit) {
+    if (options.keep_open) {
+        raise_descriptor_limit();
+    }
+    Walk walk(options, visit);
+    return walk.run(root);
+}
+
+} // namespace scanner
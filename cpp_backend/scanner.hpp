@@ -0,0 +1,165 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <span>
+#include <functional>
+#include <filesystem>
+#include <memory>
+#include <sys/stat.h>
+
+namespace utils {
+class IgnoreList;
+}
+
+namespace scanner {
+
+// Entry type as reported by d_type (Unknown when the filesystem doesn't fill it in)
+enum class EntryType : unsigned char {
+    Unknown,
+    Regular,
+    Directory,
+    Symlink,
+    Other
+};
+
+// Single directory entry. The name points into the reader's batch buffer and is
+// NUL-terminated, so name.data() can be passed straight to *at() syscalls.
+struct DirEntry {
+    std::string_view name;
+    EntryType type = EntryType::Unknown;
+    const struct stat* stat = nullptr;   // lstat result if the walk already had to stat it
+};
+
+// Reads directories in large getdents64 batches instead of one readdir per entry
+class DirectoryReader {
+public:
+    static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+    explicit DirectoryReader(size_t buffer_size = kDefaultBufferSize);
+
+    // Calls visit once per batch ("." and ".." are skipped). Entries are only
+    // valid during the callback. Returns 0 on success or an errno value.
+    int read(int dir_fd, const std::function<void(std::span<DirEntry>)>& visit);
+
+private:
+    std::vector<char> buffer_;
+    std::vector<DirEntry> batch_;
+};
+
+// Directory descriptor helpers (return -1 and set errno on failure)
+int open_directory(const std::filesystem::path& path);
+int open_directory_at(int parent_fd, const char* name);
+
+// Resolves an entry type with fstatat. Only needed for DT_UNKNOWN entries, or for
+// symlinks when the caller wants the type of the target.
+EntryType stat_type(int dir_fd, const char* name, bool follow_symlinks);
+
+// True if the entry is a regular file or a symlink to one (same semantics as
+// directory_entry::is_regular_file), stat'ing only when d_type can't tell
+bool is_regular_file(int dir_fd, const DirEntry& entry);
+
+// Owning file descriptor, closed on destruction
+class FileDescriptor {
+public:
+    explicit FileDescriptor(int fd = -1) : fd_(fd) {}
+    ~FileDescriptor();
+
+    FileDescriptor(const FileDescriptor&) = delete;
+    FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+    int get() const { return fd_; }
+
+private:
+    int fd_;
+};
+
+// Directory reached during a walk
+struct Directory {
+    std::filesystem::path path;   // full path (root joined with rel)
+    std::string rel;              // path relative to the walk root, "" for the root
+    std::shared_ptr<const utils::IgnoreList> ignore;   // exclude rules for its entries
+
+    // Only with WalkOptions::keep_open: the descriptor the walk read it through,
+    // valid for as long as this Directory lives, and the parent it was opened
+    // relative to
+    std::shared_ptr<const FileDescriptor> fd;
+    std::shared_ptr<const Directory> parent;
+
+    // Descriptor for *at() calls on its entries, -1 if it wasn't kept open
+    int dir_fd() const { return fd ? fd->get() : -1; }
+};
+
+// Decides whether to descend into a subdirectory before it is opened. rel is the
+// child's path relative to the walk root.
+using DescendFilter = std::function<bool(const Directory& parent, std::string_view name,
+                                         const std::string& rel)>;
+
+// Directory listings kept between walks (see catalog.hpp). Before reading a
+// directory the walker offers its fstat to lookup(); only when that has no
+// listing still valid for it is the directory read from disk and handed to
+// store() batch by batch (types resolved), then once more with an empty batch
+// once the read completed. A read that fails partway ends with discard()
+// instead, and its partial listing must be dropped. Called from all walk
+// workers at once.
+class ListingCache {
+public:
+    virtual ~ListingCache() = default;
+
+    // Calls visit with the cached entries (types known, no stat) and returns
+    // true, or returns false without calling it
+    virtual bool lookup(const std::filesystem::path& dir, const struct stat& dir_st,
+                        const std::function<void(std::span<DirEntry>)>& visit) = 0;
+    virtual void store(const std::filesystem::path& dir, const struct stat& dir_st, int dir_fd,
+                       std::span<const DirEntry> batch) = 0;
+    virtual void discard(const std::filesystem::path& dir, int dir_fd) = 0;
+
+    // False only if nothing in the subtree at dir has one of these final
+    // extensions (lowercased, without the dot), so a walk may skip it
+    virtual bool subtree_may_contain(const std::filesystem::path& dir,
+                                     std::span<const std::string> extensions) {
+        return true;
+    }
+};
+
+struct WalkOptions {
+    size_t threads = 0;           // worker count, 0 = hardware concurrency
+    bool recursive = true;        // descend into subdirectories
+    DescendFilter descend;        // optional subtree pruning
+
+    // Exclude rules for the root; ignore_files (e.g. ".gitignore") found in a
+    // directory add rules for its subtree. Excluded directories are never opened.
+    std::shared_ptr<const utils::IgnoreList> ignore;
+    std::vector<std::string> ignore_files;
+
+    // Keep each directory's descriptor open in Directory::fd so callers can act
+    // on entries with *at() calls after the walk moved on, and open
+    // subdirectories relative to their parent instead of by full path. Raises
+    // the soft RLIMIT_NOFILE to the hard limit since many stay open at once.
+    bool keep_open = false;
+
+    // Listings to use instead of getdents where still valid, and to fill in
+    // from the directories that had to be read
+    ListingCache* cache = nullptr;
+};
+
+// Called from worker threads with each batch read from a directory. Calls for the
+// same worker index never overlap, so per-worker state needs no locking. DT_UNKNOWN
+// entries are already resolved with an lstat (kept in DirEntry::stat); symlinks are
+// reported, not followed.
+// The directory is shared so callers can keep it alive past the callback.
+using WalkVisitor = std::function<void(size_t worker, int dir_fd,
+                                       const std::shared_ptr<const Directory>& dir,
+                                       std::span<const DirEntry> batch)>;
+
+// Resolves a requested thread count (0 = hardware concurrency, at least 1)
+size_t resolve_thread_count(size_t requested);
+
+// Walks root with work-stealing workers: each worker owns a deque of pending
+// directories (LIFO for itself, FIFO for thieves). Directories that can't be
+// opened or read are reported in the returned error list and skipped.
+std::vector<std::string> walk(const std::filesystem::path& root, const WalkOptions& options,
+                              const WalkVisitor& visit);
+
+} // namespace scanner
@@ -0,0 +1,212 @@
+#include "server.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+namespace server {
+
+namespace {
+
+// Requests beyond this are not JSON commands; the connection is dropped
+constexpr size_t kMaxRequestSize = 16 << 20;
+
+int signal_pipe[2] = {-1, -1};
+
+void on_signal(int) {
+    char byte = 0;
+    ssize_t written = write(signal_pipe[1], &byte, 1);
+    (void)written;
+}
+
+bool write_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Answers requests on one connection until the client hangs up
+void serve_connection(int fd, const Handler& handle) {
+    std::string pending;
+    char buffer[64 << 10];
+    for (;;) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        pending.append(buffer, n);
+
+        size_t start = 0;
+        for (size_t newline; (newline = pending.find('\n', start)) != std::string::npos; start = newline + 1) {
+            std::string request = pending.substr(start, newline - start);
+            if (request.find_first_not_of(" \t\r") == std::string::npos) continue;
+            std::string response = handle(request);
+            response.push_back('\n');
+            if (!write_all(fd, response.data(), response.size())) return;
+        }
+        pending.erase(0, start);
+        if (pending.size() > kMaxRequestSize) return;
+    }
+}
+
+} // namespace
+
+std::filesystem::path default_socket_path() {
+    if (const char* path = std::getenv("SMARTFILECMD_SOCKET"); path && *path) {
+        return path;
+    }
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR"); runtime && *runtime) {
+        return std::filesystem::path(runtime) / "smartfilecmd.sock";
+    }
+    return "/tmp/smartfilecmd-" + std::to_string(getuid()) + ".sock";
+}
+
+int serve(const std::filesystem::path& path, const Handler& handle) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.native().size() >= sizeof(address.sun_path)) return ENAMETOOLONG;
+    std::memcpy(address.sun_path, path.c_str(), path.native().size() + 1);
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) return errno;
+
+    // A socket file nobody answers on is left over from a server that died;
+    // anything else at path is not ours to remove
+    if (connect(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        close(listen_fd);
+        return EADDRINUSE;
+    }
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            close(listen_fd);
+            return EEXIST;
+        }
+        unlink(path.c_str());
+    }
+
+    mode_t old_mask = umask(0177);
+    int rc = bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    umask(old_mask);
+    if (rc != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        int err = errno;
+        close(listen_fd);
+        return err;
+    }
+
+    if (pipe2(signal_pipe, O_CLOEXEC) != 0) {
+        int err = errno;
+        close(listen_fd);
+        unlink(path.c_str());
+        return err;
+    }
+    struct sigaction action{};
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    struct Connection {
+        int fd;
+        std::atomic<bool> done{false};
+        std::thread thread;
+    };
+    std::list<Connection> connections;
+    auto reap = [&](bool all) {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if (!all && !it->done) {
+                ++it;
+                continue;
+            }
+            if (all) shutdown(it->fd, SHUT_RDWR);   // wakes a blocked read
+            it->thread.join();
+            close(it->fd);
+            it = connections.erase(it);
+        }
+    };
+
+    pollfd fds[2] = {{listen_fd, POLLIN, 0}, {signal_pipe[0], POLLIN, 0}};
+    int err = 0;
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        if (fds[1].revents) break;
+
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        reap(false);
+        auto& connection = connections.emplace_back();
+        connection.fd = fd;
+        connection.thread = std::thread([&handle, &connection] {
+            serve_connection(connection.fd, handle);
+            connection.done = true;
+        });
+    }
+
+    // Requests already being handled finish; then every connection closes
+    close(listen_fd);
+    unlink(path.c_str());
+    reap(true);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    close(signal_pipe[0]);
+    close(signal_pipe[1]);
+    return err;
+}
+
+catalog::Catalog* CatalogRegistry::get(const std::filesystem::path& source) {
+    auto dir = catalog::normalize(source);
+    catalog::Catalog* found = nullptr;
+    watcher::Watcher* watch = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [root, entry] : entries_) {
+            std::string prefix = root.back() == '/' ? root : root + "/";
+            if (dir.native() == root || dir.native().starts_with(prefix)) return entry.catalog.get();
+        }
+
+        // Opened under the lock, watched outside it: other commands may use
+        // the catalog meanwhile, validating listings by mtime until then
+        Entry entry;
+        entry.catalog = catalog::open_for(dir);
+        if (watch_) entry.watcher = std::make_unique<watcher::Watcher>(*entry.catalog);
+        found = entry.catalog.get();
+        watch = entry.watcher.get();
+        entries_.emplace(found->root().native(), std::move(entry));
+    }
+    if (!watch) return found;
+    for (const auto& error : watch->add(found->root())) {
+        std::cerr << "Watcher: " << error << std::endl;
+    }
+    return found;
+}
+
+void CatalogRegistry::save_all(std::vector<std::string>& errors) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [root, entry] : entries_) {
+        if (int err = entry.catalog->save(); err != 0) {
+            errors.push_back("Failed to save index " + entry.catalog->file().string() + ": " + std::strerror(err));
+        }
+    }
+}
+
+} // namespace server
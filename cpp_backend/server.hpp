@@ -0,0 +1,53 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "catalog.hpp"
+#include "watcher.hpp"
+
+namespace server {
+
+// Where a server listens unless told otherwise: $SMARTFILECMD_SOCKET, else
+// $XDG_RUNTIME_DIR/smartfilecmd.sock, else /tmp/smartfilecmd-<uid>.sock
+std::filesystem::path default_socket_path();
+
+// Answers one request line with one response line (without the newline)
+using Handler = std::function<std::string(const std::string& request)>;
+
+// Listens on a Unix stream socket at path, accessible to the owner only, until
+// SIGINT or SIGTERM. Requests and responses are single lines of JSON. Each
+// connection gets its own thread and is answered in order, so a client may
+// send several requests before reading. Returns 0 or an errno value
+// (EADDRINUSE if another server already answers at path, EEXIST if something
+// other than a socket is there).
+int serve(const std::filesystem::path& path, const Handler& handle);
+
+// Catalogs shared by all of a server's commands, one per indexed root, each
+// kept current by an inotify watcher unless watch is off
+class CatalogRegistry {
+public:
+    explicit CatalogRegistry(bool watch = true) : watch_(watch) {}
+
+    // The catalog covering source, opened (and its tree watched) on first use
+    catalog::Catalog* get(const std::filesystem::path& source);
+
+    // Writes every catalog back to disk; failures go to errors
+    void save_all(std::vector<std::string>& errors);
+
+private:
+    struct Entry {
+        std::unique_ptr<catalog::Catalog> catalog;
+        std::unique_ptr<watcher::Watcher> watcher;
+    };
+
+    bool watch_;
+    std::mutex mutex_;
+    std::map<std::string, Entry> entries_;   // by root
+};
+
+} // namespace server
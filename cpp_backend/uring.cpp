@@ -0,0 +1,572 @@
+#include "uring.hpp"
+#include "copier.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace uring {
+
+namespace {
+
+int sys_setup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int sys_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+template <typename T>
+T* at_offset(void* base, unsigned offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+} // namespace
+
+bool available() {
+    static const bool supported = [] {
+        io_uring_params params{};
+        int fd = sys_setup(2, &params);
+        if (fd < 0) return false;
+        close(fd);
+        return true;
+    }();
+    return supported;
+}
+
+Ring::Ring(unsigned entries) {
+    io_uring_params params{};
+    fd_ = sys_setup(entries, &params);
+    if (fd_ < 0) {
+        throw std::system_error(errno, std::generic_category(), "io_uring_setup");
+    }
+    sq_entries_ = params.sq_entries;
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    auto map = [&](size_t size, off_t offset) {
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, offset);
+        if (ptr == MAP_FAILED) {
+            int err = errno;
+            unmap();
+            throw std::system_error(err, std::generic_category(), "io_uring mmap");
+        }
+        return ptr;
+    };
+    sq_ring_ = map(sq_ring_size_, IORING_OFF_SQ_RING);
+    cq_ring_ = single_mmap ? sq_ring_ : map(cq_ring_size_, IORING_OFF_CQ_RING);
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(map(sqes_size_, IORING_OFF_SQES));
+
+    sq_head_ = at_offset<unsigned>(sq_ring_, params.sq_off.head);
+    sq_tail_ = at_offset<unsigned>(sq_ring_, params.sq_off.tail);
+    sq_mask_ = *at_offset<unsigned>(sq_ring_, params.sq_off.ring_mask);
+    sq_array_ = at_offset<unsigned>(sq_ring_, params.sq_off.array);
+    cq_head_ = at_offset<unsigned>(cq_ring_, params.cq_off.head);
+    cq_tail_ = at_offset<unsigned>(cq_ring_, params.cq_off.tail);
+    cq_mask_ = *at_offset<unsigned>(cq_ring_, params.cq_off.ring_mask);
+    cqes_ = at_offset<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+    sqe_tail_ = *sq_tail_;
+}
+
+Ring::~Ring() {
+    unmap();
+}
+
+void Ring::unmap() {
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ring_ && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_size_);
+    if (sq_ring_) munmap(sq_ring_, sq_ring_size_);
+    if (fd_ >= 0) close(fd_);
+    sqes_ = nullptr;
+    cq_ring_ = sq_ring_ = nullptr;
+    fd_ = -1;
+}
+
+unsigned Ring::sq_space() const {
+    unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+    return sq_entries_ - (sqe_tail_ - head);
+}
+
+io_uring_sqe* Ring::next_sqe() {
+    if (sq_space() == 0) return nullptr;
+
+    unsigned index = sqe_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    sqe_tail_++;
+    unsubmitted_++;
+    return sqe;
+}
+
+int Ring::submit(unsigned wait_for) {
+    std::atomic_ref<unsigned>(*sq_tail_).store(sqe_tail_, std::memory_order_release);
+    for (;;) {
+        int n = sys_enter(fd_, unsubmitted_, wait_for, wait_for > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        unsubmitted_ -= std::min<unsigned>(n, unsubmitted_);
+        return n;
+    }
+}
+
+int Ring::register_buffers(const std::vector<iovec>& buffers) {
+    if (sys_register(fd_, IORING_REGISTER_BUFFERS, buffers.data(), buffers.size()) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+bool Ring::supports(unsigned opcode) const {
+    constexpr unsigned kProbeOps = 256;
+    std::vector<char> storage(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op), 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (sys_register(fd_, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) return false;
+    return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+}
+
+unsigned Ring::cq_head_load() const {
+    return std::atomic_ref<unsigned>(*cq_head_).load(std::memory_order_relaxed);
+}
+
+unsigned Ring::cq_tail_load() const {
+    return std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+}
+
+void Ring::cq_head_store(unsigned head) {
+    std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+}
+
+const io_uring_cqe* Ring::cqe_at(unsigned index) const {
+    return &cqes_[index & cq_mask_];
+}
+
+// File being copied. Ranges handed back by short reads are redone first.
+struct BatchCopier::File {
+    size_t request = 0;
+    int src_fd = -1;
+    int dst_fd = -1;
+    uint64_t size = 0;
+    uint64_t next = 0;                // first byte not yet handed to a slot
+    uint64_t eof = UINT64_MAX;        // where a read hit EOF (the file shrank)
+    std::vector<std::pair<uint64_t, uint64_t>> retry;   // (offset, length)
+    unsigned inflight = 0;
+    int error = 0;
+
+    bool has_work() const { return error == 0 && (!retry.empty() || next < size); }
+};
+
+// One registered buffer and the I/O it is carrying
+struct BatchCopier::Slot {
+    size_t index = 0;
+    size_t file = 0;
+    uint64_t offset = 0;
+    uint32_t length = 0;              // bytes requested from the source
+    uint32_t valid = 0;               // bytes read into the buffer
+    uint32_t written = 0;
+    int read_result = 0;
+    int write_result = 0;
+    unsigned pending = 0;             // CQEs still expected
+    bool write_only = false;
+    char* buffer = nullptr;
+};
+
+BatchCopier::BatchCopier(unsigned queue_depth, size_t buffer_size)
+    : ring_(std::max(queue_depth, 2u)),
+      buffer_size_(std::max<size_t>(buffer_size, 4096) & ~size_t{4095}),
+      buffers_(nullptr, std::free) {
+    // Each slot has a read and a write in flight
+    size_t slot_count = std::max<unsigned>(ring_.entries() / 2, 1);
+    buffers_.reset(static_cast<char*>(std::aligned_alloc(4096, slot_count * buffer_size_)));
+    if (!buffers_) throw std::bad_alloc();
+
+    std::vector<iovec> iovecs(slot_count);
+    slots_.resize(slot_count);
+    for (size_t i = 0; i < slot_count; ++i) {
+        slots_[i].index = i;
+        slots_[i].buffer = buffers_.get() + i * buffer_size_;
+        iovecs[i] = {slots_[i].buffer, buffer_size_};
+    }
+
+    // Registration can fail under a tight RLIMIT_MEMLOCK; plain READ/WRITE still work
+    fixed_buffers_ = ring_.register_buffers(iovecs) == 0;
+}
+
+BatchCopier::~BatchCopier() = default;
+
+bool BatchCopier::issue_pair(Slot& slot) {
+    if (ring_.sq_space() < 2) return false;
+    io_uring_sqe* read = ring_.next_sqe();
+    io_uring_sqe* write = ring_.next_sqe();
+    const File& file = files_[slot.file];
+
+    read->opcode = fixed_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    read->fd = file.src_fd;
+    read->addr = reinterpret_cast<uint64_t>(slot.buffer);
+    read->len = slot.length;
+    read->off = slot.offset;
+    read->buf_index = static_cast<uint16_t>(slot.index);
+    read->flags = IOSQE_IO_LINK;      // the write only starts once the read is done
+    read->user_data = slot.index * 2;
+
+    write->opcode = fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    write->fd = file.dst_fd;
+    write->addr = reinterpret_cast<uint64_t>(slot.buffer);
+    write->len = slot.length;
+    write->off = slot.offset;
+    write->buf_index = static_cast<uint16_t>(slot.index);
+    write->user_data = slot.index * 2 + 1;
+
+    slot.write_only = false;
+    slot.valid = slot.written = 0;
+    slot.pending = 2;
+    return true;
+}
+
+bool BatchCopier::issue_write(Slot& slot) {
+    io_uring_sqe* write = ring_.next_sqe();
+    if (!write) return false;
+
+    write->opcode = fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    write->fd = files_[slot.file].dst_fd;
+    write->addr = reinterpret_cast<uint64_t>(slot.buffer + slot.written);
+    write->len = slot.valid - slot.written;
+    write->off = slot.offset + slot.written;
+    write->buf_index = static_cast<uint16_t>(slot.index);
+    write->user_data = slot.index * 2 + 1;
+
+    slot.write_only = true;
+    slot.pending = 1;
+    return true;
+}
+
+std::vector<int> BatchCopier::copy(const std::vector<CopyRequest>& requests) {
+    std::vector<int> results(requests.size(), 0);
+    files_.clear();
+    size_t next_request = 0;
+    size_t open_files = 0;
+    size_t first_active = 0;          // files before this one are finished
+
+    std::vector<Slot*> free_slots;
+    for (auto& slot : slots_) free_slots.push_back(&slot);
+    std::vector<Slot*> retry_writes;   // slots whose follow-up write didn't fit the ring
+
+    auto finish = [&](File& file) {
+        int err = file.error;
+        if (err == 0 && file.eof < file.size && ftruncate(file.dst_fd, file.eof) != 0) {
+            err = errno;
+        }
+        close(file.src_fd);
+        if (close(file.dst_fd) != 0 && err == 0) err = errno;
+        file.src_fd = file.dst_fd = -1;
+        results[file.request] = err;
+        open_files--;
+    };
+
+    auto open_next = [&] {
+        size_t request = next_request++;
+        File file;
+        file.request = request;
+        struct stat src_st;
+        struct stat dst_st;
+        const CopyRequest& req = requests[request];
+        int err = copier::open_for_copy_at(req.src_dir, req.src.c_str(), req.dst_dir, req.dst.c_str(),
+                                           file.src_fd, file.dst_fd, src_st, dst_st);
+        if (err != 0) {
+            results[request] = err;
+            return;
+        }
+        file.size = src_st.st_size;
+        files_.push_back(std::move(file));
+        open_files++;
+        if (files_.back().size == 0) finish(files_.back());
+    };
+
+    // Keeps roughly one open file per slot: enough to fill the queue with small files
+    auto pick_file = [&]() -> File* {
+        for (;;) {
+            for (size_t i = first_active; i < files_.size(); ++i) {
+                if (files_[i].src_fd >= 0 && files_[i].has_work()) return &files_[i];
+            }
+            if (next_request >= requests.size() || open_files >= slots_.size()) return nullptr;
+            open_next();
+        }
+    };
+
+    auto release = [&](Slot& slot) {
+        File& file = files_[slot.file];
+        free_slots.push_back(&slot);
+        if (--file.inflight == 0 && !file.has_work()) finish(file);
+    };
+
+    // Decides what a slot does next once all of its CQEs are in
+    auto settle = [&](Slot& slot) {
+        File& file = files_[slot.file];
+        if (!slot.write_only) {
+            if (slot.read_result < 0) {
+                file.error = -slot.read_result;
+                return release(slot);
+            }
+            if (slot.read_result == 0) {
+                file.eof = std::min(file.eof, slot.offset);
+                return release(slot);
+            }
+            slot.valid = slot.read_result;
+            if (slot.valid < slot.length) {
+                // A short read breaks the link: the write was cancelled
+                file.retry.emplace_back(slot.offset + slot.valid, slot.length - slot.valid);
+            } else if (slot.write_result >= 0) {
+                slot.written = slot.write_result;
+            } else if (slot.write_result != -ECANCELED) {
+                file.error = -slot.write_result;
+                return release(slot);
+            }
+        } else if (slot.write_result > 0) {
+            slot.written += slot.write_result;
+        } else if (slot.write_result != -EINTR && slot.write_result != -EAGAIN) {
+            file.error = slot.write_result < 0 ? -slot.write_result : EIO;
+            return release(slot);
+        }
+
+        if (slot.written < slot.valid) {
+            if (!issue_write(slot)) retry_writes.push_back(&slot);
+            return;
+        }
+        release(slot);
+    };
+
+    for (;;) {
+        while (!retry_writes.empty() && issue_write(*retry_writes.back())) {
+            retry_writes.pop_back();
+        }
+
+        while (!free_slots.empty()) {
+            File* file = pick_file();
+            if (!file) break;
+
+            Slot& slot = *free_slots.back();
+            slot.file = file - files_.data();
+            if (!file->retry.empty()) {
+                slot.offset = file->retry.back().first;
+                slot.length = static_cast<uint32_t>(file->retry.back().second);
+                file->retry.pop_back();
+            } else {
+                slot.offset = file->next;
+                slot.length = static_cast<uint32_t>(std::min<uint64_t>(buffer_size_, file->size - file->next));
+                file->next += slot.length;
+            }
+            if (!issue_pair(slot)) {
+                file->retry.emplace_back(slot.offset, slot.length);
+                break;
+            }
+            free_slots.pop_back();
+            file->inflight++;
+        }
+
+        while (first_active < files_.size() && files_[first_active].src_fd < 0) {
+            first_active++;
+        }
+        if (free_slots.size() == slots_.size() && retry_writes.empty()) {
+            break;   // nothing in flight and pick_file found no more work
+        }
+
+        int rc = ring_.submit(1);
+        if (rc < 0 && rc != -EBUSY && rc != -EAGAIN) {
+            throw std::system_error(-rc, std::generic_category(), "io_uring_enter");
+        }
+
+        ring_.drain([&](const io_uring_cqe& cqe) {
+            Slot& slot = slots_[cqe.user_data / 2];
+            if (cqe.user_data % 2 == 0) {
+                slot.read_result = cqe.res;
+            } else {
+                slot.write_result = cqe.res;
+            }
+            if (--slot.pending == 0) settle(slot);
+        });
+    }
+
+    files_.clear();
+    return results;
+}
+
+struct MetadataBatch::Op {
+    enum Kind : unsigned { Rename, Unlink, Mkdir, Statx };
+
+    Kind kind;
+    int dir = AT_FDCWD;
+    std::string name;
+    int other_dir = AT_FDCWD;
+    std::string other_name;
+    unsigned flags = 0;               // rename/unlink/statx flags
+    unsigned arg = 0;                 // mkdir mode, statx mask
+    struct statx* out = nullptr;
+    bool linked = false;              // next op waits for this one to finish
+};
+
+MetadataBatch::MetadataBatch(unsigned queue_depth) {
+    if (queue_depth == 0 || !available()) return;
+    try {
+        ring_ = std::make_unique<Ring>(std::max(queue_depth, 2u));
+    } catch (const std::system_error&) {
+        return;
+    }
+    const unsigned opcodes[] = {IORING_OP_RENAMEAT, IORING_OP_UNLINKAT, IORING_OP_MKDIRAT, IORING_OP_STATX};
+    for (unsigned kind = 0; kind < 4; ++kind) {
+        if (ring_->supports(opcodes[kind])) native_ |= 1u << kind;
+    }
+}
+
+MetadataBatch::~MetadataBatch() = default;
+
+size_t MetadataBatch::push(Op op) {
+    ops_.push_back(std::move(op));
+    return ops_.size() - 1;
+}
+
+size_t MetadataBatch::rename(int old_dir, std::string old_name, int new_dir, std::string new_name,
+                             unsigned flags) {
+    return push({Op::Rename, old_dir, std::move(old_name), new_dir, std::move(new_name), flags});
+}
+
+size_t MetadataBatch::unlink(int dir, std::string name, int flags) {
+    return push({Op::Unlink, dir, std::move(name), AT_FDCWD, {}, static_cast<unsigned>(flags)});
+}
+
+size_t MetadataBatch::mkdir(int dir, std::string name, mode_t mode) {
+    return push({Op::Mkdir, dir, std::move(name), AT_FDCWD, {}, 0, static_cast<unsigned>(mode)});
+}
+
+size_t MetadataBatch::statx(int dir, std::string name, int flags, unsigned mask, struct statx* out) {
+    return push({Op::Statx, dir, std::move(name), AT_FDCWD, {}, static_cast<unsigned>(flags), mask, out});
+}
+
+size_t MetadataBatch::size() const {
+    return ops_.size();
+}
+
+void MetadataBatch::link() {
+    if (!ops_.empty()) ops_.back().linked = true;
+}
+
+int MetadataBatch::run_sync(const Op& op) const {
+    int rc = -1;
+    switch (op.kind) {
+        case Op::Rename:
+            rc = op.flags ? renameat2(op.dir, op.name.c_str(), op.other_dir, op.other_name.c_str(), op.flags)
+                          : renameat(op.dir, op.name.c_str(), op.other_dir, op.other_name.c_str());
+            break;
+        case Op::Unlink:
+            rc = unlinkat(op.dir, op.name.c_str(), op.flags);
+            break;
+        case Op::Mkdir:
+            rc = mkdirat(op.dir, op.name.c_str(), op.arg);
+            break;
+        case Op::Statx:
+            rc = ::statx(op.dir, op.name.c_str(), op.flags, op.arg, op.out);
+            break;
+    }
+    return rc == 0 ? 0 : errno;
+}
+
+std::vector<int> MetadataBatch::run() {
+    std::vector<int> results(ops_.size(), 0);
+
+    auto run_chain_sync = [&](size_t first, size_t end) {
+        for (size_t i = first; i < end; ++i) {
+            results[i] = run_sync(ops_[i]);
+        }
+    };
+
+    size_t next = 0;
+    unsigned inflight = 0;
+    while (next < ops_.size() || inflight > 0) {
+        // Queue whole chains while they fit; links can't span two submissions
+        while (next < ops_.size()) {
+            size_t end = next;
+            bool native = true;
+            for (;; ++end) {
+                native = native && (native_ & (1u << ops_[end].kind));
+                if (!ops_[end].linked || end + 1 == ops_.size()) break;
+            }
+            ++end;
+
+            if (!ring_ || !native || end - next > ring_->entries()) {
+                run_chain_sync(next, end);
+                next = end;
+                continue;
+            }
+            if (end - next > ring_->sq_space()) break;
+
+            for (size_t i = next; i < end; ++i) {
+                const Op& op = ops_[i];
+                io_uring_sqe* sqe = ring_->next_sqe();
+                sqe->fd = op.dir;
+                sqe->addr = reinterpret_cast<uint64_t>(op.name.c_str());
+                sqe->user_data = i;
+                if (i + 1 < end) sqe->flags = IOSQE_IO_HARDLINK;   // a plain link cancels the rest on failure
+                switch (op.kind) {
+                    case Op::Rename:
+                        sqe->opcode = IORING_OP_RENAMEAT;
+                        sqe->len = static_cast<uint32_t>(op.other_dir);
+                        sqe->addr2 = reinterpret_cast<uint64_t>(op.other_name.c_str());
+                        sqe->rename_flags = op.flags;
+                        break;
+                    case Op::Unlink:
+                        sqe->opcode = IORING_OP_UNLINKAT;
+                        sqe->unlink_flags = op.flags;
+                        break;
+                    case Op::Mkdir:
+                        sqe->opcode = IORING_OP_MKDIRAT;
+                        sqe->len = op.arg;
+                        break;
+                    case Op::Statx:
+                        sqe->opcode = IORING_OP_STATX;
+                        sqe->len = op.arg;
+                        sqe->off = reinterpret_cast<uint64_t>(op.out);
+                        sqe->statx_flags = op.flags;
+                        break;
+                }
+            }
+            inflight += end - next;
+            next = end;
+        }
+        if (inflight == 0) continue;
+
+        int rc = ring_->submit(1);
+        if (rc < 0 && rc != -EBUSY && rc != -EAGAIN) {
+            throw std::system_error(-rc, std::generic_category(), "io_uring_enter");
+        }
+        inflight -= ring_->drain([&](const io_uring_cqe& cqe) {
+            results[cqe.user_data] = cqe.res < 0 ? -cqe.res : 0;
+        });
+    }
+
+    ops_.clear();
+    return results;
+}
+
+} // namespace uring
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace uring {
+
+// True if the kernel lets this process create an io_uring (checked once)
+bool available();
+
+// Minimal io_uring wrapper over the raw syscalls: one submission and one
+// completion ring, owned by a single thread.
+class Ring {
+public:
+    // Throws std::system_error if io_uring_setup fails
+    explicit Ring(unsigned entries);
+    ~Ring();
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    // Zeroed SQE at the tail of the submission ring, or nullptr when it is full
+    io_uring_sqe* next_sqe();
+
+    // Free SQEs left before the next submit()
+    unsigned sq_space() const;
+
+    // Hands queued SQEs to the kernel and waits for at least wait_for
+    // completions. Returns the number submitted or -errno.
+    int submit(unsigned wait_for = 0);
+
+    // Calls handle(cqe) for every completion posted so far; returns the count
+    template <typename Handle>
+    unsigned drain(Handle handle) {
+        unsigned head = cq_head_load();
+        unsigned tail = cq_tail_load();
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count) {
+            handle(*cqe_at(head));
+        }
+        cq_head_store(head);
+        return count;
+    }
+
+    // Registers buffers for IORING_OP_{READ,WRITE}_FIXED (buf_index = position).
+    // Returns 0 or -errno.
+    int register_buffers(const std::vector<iovec>& buffers);
+
+    unsigned entries() const { return sq_entries_; }
+
+    // Whether the kernel implements an IORING_OP_* (IORING_REGISTER_PROBE)
+    bool supports(unsigned opcode) const;
+
+private:
+    void unmap();
+    unsigned cq_head_load() const;
+    unsigned cq_tail_load() const;
+    void cq_head_store(unsigned head);
+    const io_uring_cqe* cqe_at(unsigned index) const;
+
+    int fd_ = -1;
+    unsigned sq_entries_ = 0;
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    unsigned sqe_tail_ = 0;       // local tail, published by submit()
+    unsigned unsubmitted_ = 0;
+};
+
+// src and dst are resolved relative to src_dir / dst_dir (openat semantics)
+struct CopyRequest {
+    std::filesystem::path src;
+    std::filesystem::path dst;
+    int src_dir = AT_FDCWD;
+    int dst_dir = AT_FDCWD;
+};
+
+// Copies many files from one thread with up to queue_depth I/Os in flight.
+// Every buffer slot runs a linked READ_FIXED -> WRITE_FIXED pair; slots are
+// spread over as many open files as needed to keep them busy, so a batch of
+// small files overlaps just like the ranges of one large file do.
+class BatchCopier {
+public:
+    static constexpr unsigned kDefaultQueueDepth = 128;
+    static constexpr size_t kDefaultBufferSize = 128 << 10;
+
+    // Throws std::system_error if the ring can't be created
+    explicit BatchCopier(unsigned queue_depth = kDefaultQueueDepth,
+                         size_t buffer_size = kDefaultBufferSize);
+    ~BatchCopier();
+
+    // Copies each src over dst with copier::copy_file semantics (create or
+    // truncate, permission bits kept). Returns 0 or an errno value per request.
+    std::vector<int> copy(const std::vector<CopyRequest>& requests);
+
+private:
+    struct File;
+    struct Slot;
+
+    bool issue_pair(Slot& slot);
+    bool issue_write(Slot& slot);
+
+    Ring ring_;
+    size_t buffer_size_;
+    std::unique_ptr<char, void (*)(void*)> buffers_;
+    bool fixed_buffers_ = false;
+    std::vector<Slot> slots_;
+    std::vector<File> files_;
+};
+
+// Metadata syscalls queued up and then issued together as IORING_OP_RENAMEAT,
+// UNLINKAT, MKDIRAT and STATX SQEs, up to queue_depth per io_uring_enter. Ops
+// the kernel doesn't know (older than 5.11/5.15), or every op when io_uring
+// itself is unavailable, run as plain syscalls instead, so callers don't need
+// a separate fallback path.
+class MetadataBatch {
+public:
+    static constexpr unsigned kDefaultQueueDepth = 256;
+
+    // queue_depth 0 runs every op as a plain syscall
+    explicit MetadataBatch(unsigned queue_depth = kDefaultQueueDepth);
+    ~MetadataBatch();
+
+    // Each returns the op's index into run()'s results. Paths are relative to
+    // the directory descriptors (or AT_FDCWD), as with the *at() syscalls.
+    size_t rename(int old_dir, std::string old_name, int new_dir, std::string new_name,
+                  unsigned flags = 0);
+    size_t unlink(int dir, std::string name, int flags = 0);
+    size_t mkdir(int dir, std::string name, mode_t mode = 0777);
+    // out must stay valid until run() returns
+    size_t statx(int dir, std::string name, int flags, unsigned mask, struct statx* out);
+
+    // Makes the next op start only after the last queued one has finished.
+    // Ordering only: the chain is hard-linked (IOSQE_IO_HARDLINK), so a failed
+    // op doesn't cancel the rest of it, as with the syscall fallback.
+    void link();
+
+    size_t size() const;
+
+    // Runs everything queued and waits for it. Returns 0 or an errno value per
+    // op in queue order, then clears the queue.
+    std::vector<int> run();
+
+    bool uses_io_uring() const { return ring_ != nullptr; }
+
+private:
+    struct Op;
+
+    size_t push(Op op);
+    int run_sync(const Op& op) const;
+
+    std::unique_ptr<Ring> ring_;
+    std::vector<Op> ops_;
+    unsigned native_ = 0;         // bit per op kind the ring can run
+};
+
+} // namespace uring
@@ -1,9 +1,20 @@
 #include "utils.hpp"
+#include "scanner.hpp"
+#include "bounded_queue.hpp"
+#include "pattern.hpp"
+#include "ignore.hpp"
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <iomanip>
+#include <iterator>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 
 namespace utils {
 
@@ -64,91 +75,174 @@ std::vector<std::filesystem::path> scan_directory(const std::filesystem::path& d
         return files;
     }
     
-    try {
-        for (const auto& entry : std::filesystem::directory_iterator(dir_path)) {
-            if (entry.is_regular_file()) {
-                files.push_back(entry.path());
+    // Silently skip directories we can't access
+    int dir_fd = scanner::open_directory(dir_path);
+    if (dir_fd < 0) {
+        return files;
+    }
+    
+    // d_type classifies almost every entry; only DT_UNKNOWN and symlinks get stat'ed
+    scanner::DirectoryReader reader;
+    reader.read(dir_fd, [&](std::span<scanner::DirEntry> batch) {
+        for (const auto& entry : batch) {
+            if (scanner::is_regular_file(dir_fd, entry)) {
+                files.emplace_back(dir_path / entry.name);
             }
         }
-    } catch (const std::filesystem::filesystem_error& e) {
-        // Silently skip directories we can't access
-    }
+    });
+    close(dir_fd);
     
     return files;
 }
 
-std::vector<std::filesystem::path> scan_directory_recursive(const std::filesystem::path& dir_path) {
+std::vector<std::filesystem::path> scan_directory_recursive(const std::filesystem::path& dir_path,
+                                                            size_t threads,
+                                                            std::vector<std::string>* errors) {
     std::vector<std::filesystem::path> files;
     
     if (!std::filesystem::exists(dir_path) || !std::filesystem::is_directory(dir_path)) {
         return files;
     }
     
-    try {
-        for (const auto& entry : std::filesystem::recursive_directory_iterator(dir_path)) {
-            if (entry.is_regular_file()) {
-                files.push_back(entry.path());
+    // Each worker fills its own vector; they are concatenated after the walk
+    scanner::WalkOptions options;
+    options.threads = scanner::resolve_thread_count(threads);
+    std::vector<std::vector<std::filesystem::path>> per_worker(options.threads);
+    
+    auto walk_errors = scanner::walk(dir_path, options,
+        [&](size_t worker, int dir_fd, const std::shared_ptr<const scanner::Directory>& dir,
+            std::span<const scanner::DirEntry> batch) {
+            for (const auto& entry : batch) {
+                if (scanner::is_regular_file(dir_fd, entry)) {
+                    per_worker[worker].emplace_back(dir->path / entry.name);
+                }
             }
-        }
-    } catch (const std::filesystem::filesystem_error& e) {
-        // Silently skip directories we can't access
+        });
+    
+    size_t total = 0;
+    for (const auto& worker_files : per_worker) {
+        total += worker_files.size();
+    }
+    files.reserve(total);
+    for (auto& worker_files : per_worker) {
+        std::move(worker_files.begin(), worker_files.end(), std::back_inserter(files));
+    }
+    
+    if (errors) {
+        errors->insert(errors->end(), walk_errors.begin(), walk_errors.end());
     }
     
     return files;
 }
 
-bool matches_pattern(const std::string& filename, const std::string& pattern) {
-    // Simple pattern matching for backward compatibility
-    if (pattern.empty()) return true;
+StreamStats stream_files(const std::filesystem::path& dir_path, const StreamOptions& stream_options,
+                         const PatternMatcher& matcher, const FileFilter& filter,
+                         const std::function<void(FileBatch&)>& consume,
+                         std::vector<std::string>* errors) {
+    StreamStats stats;
     
-    // Check if it's a glob pattern
-    if (pattern.find('*') != std::string::npos || pattern.find('?') != std::string::npos) {
-        return matches_glob_pattern(filename, pattern);
+    if (!std::filesystem::exists(dir_path) || !std::filesystem::is_directory(dir_path)) {
+        return stats;
     }
     
-    // Simple extension matching
-    if (pattern[0] == '.') {
-        return filename.ends_with(pattern);
+    // A path pattern names files below the root, so it always descends, but only
+    // into directories whose relative path can still lead to a match
+    scanner::WalkOptions options;
+    options.recursive = stream_options.recursive || matcher.is_path_pattern();
+    options.threads = options.recursive ? scanner::resolve_thread_count(stream_options.threads) : 1;
+    options.ignore = stream_options.ignore;
+    options.keep_open = stream_options.keep_open;
+    options.cache = stream_options.cache;
+    if (stream_options.use_ignore_files) {
+        options.ignore_files = kIgnoreFileNames;
     }
-    
-    // Exact filename matching
-    return filename == pattern;
-}
-
-bool matches_glob_pattern(const std::string& filename, const std::string& pattern) {
-    // Convert glob pattern to regex
-    std::string regex_pattern = pattern;
-    
-    // Handle ** recursive patterns
-    if (regex_pattern.find("**") != std::string::npos) {
-        // Replace ** with .* for regex
-        size_t pos = 0;
-        while ((pos = regex_pattern.find("**", pos)) != std::string::npos) {
-            regex_pattern.replace(pos, 2, ".*");
-            pos += 2;
-        }
+    // An extension query skips subtrees the cache knows hold no such files
+    auto& extensions = matcher.final_extensions();
+    bool prune = options.cache && !extensions.empty();
+    if (matcher.is_path_pattern() || prune) {
+        options.descend = [&](const scanner::Directory& parent, std::string_view name, const std::string& rel) {
+            if (matcher.is_path_pattern() && !matcher.may_match_under(rel)) return false;
+            return !prune || options.cache->subtree_may_contain(parent.path / name, extensions);
+        };
     }
     
-    // Escape regex special characters except * and ?
-    std::string escaped;
-    for (char c : regex_pattern) {
-        if (c == '*' || c == '?') {
-            if (c == '*') escaped += ".*";
-            else if (c == '?') escaped += ".";
-        } else if (std::string("()[]{}.+^$|\\").find(c) != std::string::npos) {
-            escaped += "\\" + std::string(1, c);
-        } else {
-            escaped += c;
+    std::atomic<size_t> scanned{0};
+    std::atomic<size_t> matched{0};
+    BoundedQueue<FileBatch> queue(kStreamQueueCapacity);
+    std::vector<std::string> walk_errors;
+    std::vector<std::vector<uint8_t>> match_flags(options.threads);
+    
+    // The walk runs on its own threads; matches flow to the caller through the queue
+    std::thread producer([&] {
+        walk_errors = scanner::walk(dir_path, options,
+            [&](size_t worker, int dir_fd, const std::shared_ptr<const scanner::Directory>& dir,
+                std::span<const scanner::DirEntry> batch) {
+                // Names are matched straight from the getdents buffer, a batch at a time
+                auto& flags = match_flags[worker];
+                flags.resize(batch.size());
+                matcher.match_batch(batch, dir->rel, flags.data());
+                
+                FileBatch pending{dir, {}};
+                size_t batch_scanned = 0;
+                for (size_t i = 0; i < batch.size(); ++i) {
+                    const auto& entry = batch[i];
+                    
+                    // Symlinks are followed (like is_regular_file); the stat is handed on
+                    struct stat followed;
+                    const struct stat* known = entry.stat;
+                    if (entry.type == scanner::EntryType::Symlink || entry.type == scanner::EntryType::Unknown) {
+                        if (fstatat(dir_fd, entry.name.data(), &followed, 0) != 0 || !S_ISREG(followed.st_mode)) continue;
+                        known = &followed;
+                    } else if (entry.type != scanner::EntryType::Regular) {
+                        continue;
+                    }
+                    batch_scanned++;
+                    if (!flags[i]) continue;
+                    if (dir->ignore && dir->ignore->ignored(dir->rel, entry.name, false)) continue;
+                    if (filter && !filter(dir_fd, *dir, entry, known)) continue;
+                    
+                    pending.names.emplace_back(entry.name);
+                    if (pending.names.size() == kStreamBatchSize) {
+                        matched.fetch_add(pending.names.size(), std::memory_order_relaxed);
+                        queue.push(std::exchange(pending, FileBatch{dir, {}}));
+                    }
+                }
+                scanned.fetch_add(batch_scanned, std::memory_order_relaxed);
+                if (!pending.names.empty()) {
+                    matched.fetch_add(pending.names.size(), std::memory_order_relaxed);
+                    queue.push(std::move(pending));
+                }
+            });
+        queue.close();
+    });
+    
+    try {
+        while (auto batch = queue.pop()) {
+            consume(*batch);
         }
+    } catch (...) {
+        // Unblock the walkers before propagating
+        queue.close();
+        producer.join();
+        throw;
     }
+    producer.join();
     
-    try {
-        std::regex re(escaped, std::regex::icase);
-        return std::regex_match(filename, re);
-    } catch (const std::regex_error&) {
-        // If regex compilation fails, fall back to simple matching
-        return filename.find(pattern) != std::string::npos;
+    stats.files_scanned = scanned.load();
+    stats.files_matched = matched.load();
+    if (errors) {
+        errors->insert(errors->end(), walk_errors.begin(), walk_errors.end());
     }
+    return stats;
+}
+
+bool matches_pattern(const std::string& filename, const std::string& pattern) {
+    // One-off convenience; hot loops should build a PatternMatcher once
+    return PatternMatcher(pattern).matches(filename);
+}
+
+bool matches_glob_pattern(const std::string& filename, const std::string& pattern) {
+    return GlobMatcher(pattern).matches(filename);
 }
 
 std::filesystem::path expand_path(const std::string& path_string) {
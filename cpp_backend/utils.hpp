@@ -2,10 +2,13 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <filesystem>
-#include <regex>
 #include <chrono>
 #include <optional>
+#include <functional>
+#include <memory>
+#include "scanner.hpp"
 
 namespace utils {
 
@@ -19,6 +22,8 @@ struct FileOpResult {
     size_t files_matched = 0;
     size_t files_affected = 0;
     std::vector<std::string> errors;
+    std::vector<std::pair<std::string, std::string>> digests;   // hash: file path, hex digest
+    std::vector<std::vector<std::string>> duplicate_groups;     // find_duplicates: paths, keeper first
     std::chrono::high_resolution_clock::time_point start_time;
     std::chrono::high_resolution_clock::time_point end_time;
 };
@@ -30,7 +35,52 @@ bool requires_confirmation(const std::string& action, const std::filesystem::pat
 
 // File scanning and pattern matching
 std::vector<std::filesystem::path> scan_directory(const std::filesystem::path& dir_path);
-std::vector<std::filesystem::path> scan_directory_recursive(const std::filesystem::path& dir_path);
+// Parallel walk; threads = 0 uses hardware concurrency. Unreadable subdirectories
+// are skipped and, if errors is given, reported there.
+std::vector<std::filesystem::path> scan_directory_recursive(const std::filesystem::path& dir_path,
+                                                            size_t threads = 0,
+                                                            std::vector<std::string>* errors = nullptr);
+// Streaming scan: matched files are handed to the consumer in per-directory
+// batches while the walk is still running. Memory is bounded by the pending
+// directories plus kStreamQueueCapacity batches of kStreamBatchSize names.
+struct FileBatch {
+    std::shared_ptr<const scanner::Directory> dir;
+    std::vector<std::string> names;
+};
+
+struct StreamStats {
+    size_t files_scanned = 0;
+    size_t files_matched = 0;
+};
+
+constexpr size_t kStreamQueueCapacity = 64;
+constexpr size_t kStreamBatchSize = 1024;
+
+// Runs on walker threads for every regular file whose name matched; return true
+// to keep it. known is a stat the scan already did for the entry, or nullptr.
+// May be empty.
+using FileFilter = std::function<bool(int dir_fd, const scanner::Directory& dir,
+                                      const scanner::DirEntry& entry, const struct stat* known)>;
+
+class PatternMatcher;
+class IgnoreList;
+
+struct StreamOptions {
+    bool recursive = false;
+    size_t threads = 0;                          // 0 = hardware concurrency
+    std::shared_ptr<const IgnoreList> ignore;    // exclude rules at the root
+    bool use_ignore_files = false;               // honor .gitignore/.smartfileignore
+    bool keep_open = false;                      // batches carry open directory fds
+    scanner::ListingCache* cache = nullptr;      // listings kept between walks
+};
+
+// Walks dir_path (recursively if asked) and calls consume on the calling thread
+StreamStats stream_files(const std::filesystem::path& dir_path, const StreamOptions& options,
+                         const PatternMatcher& matcher, const FileFilter& filter,
+                         const std::function<void(FileBatch&)>& consume,
+                         std::vector<std::string>* errors = nullptr);
+
+// Single-shot matching; compile a PatternMatcher (pattern.hpp) to match many names
 bool matches_pattern(const std::string& filename, const std::string& pattern);
 bool matches_glob_pattern(const std::string& filename, const std::string& pattern);
 
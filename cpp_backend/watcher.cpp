@@ -0,0 +1,223 @@
+#include "watcher.hpp"
+#include <cerrno>
+#include <cstring>
+#include <set>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+namespace watcher {
+
+namespace {
+
+// Only changes to the set of names matter; the catalog hands out names and types
+constexpr uint32_t kEvents = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF |
+                             IN_ONLYDIR | IN_DONT_FOLLOW;
+
+constexpr size_t kEventBufferSize = 64 << 10;
+
+} // namespace
+
+Watcher::Watcher(catalog::Catalog& catalog) : catalog_(catalog) {
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (fd_ < 0 || stop_fd_ < 0) {
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+        return;
+    }
+    thread_ = std::thread([this] { run(); });
+}
+
+Watcher::~Watcher() {
+    if (thread_.joinable()) {
+        uint64_t one = 1;
+        ssize_t written = write(stop_fd_, &one, sizeof(one));
+        (void)written;
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& [dir, wd] : watches_) {
+        catalog_.unwatch(dir);
+    }
+    if (fd_ >= 0) close(fd_);
+    if (stop_fd_ >= 0) close(stop_fd_);
+}
+
+size_t Watcher::watched() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return watches_.size();
+}
+
+int Watcher::watch_directory(const std::filesystem::path& dir) {
+    int wd = inotify_add_watch(fd_, dir.c_str(), kEvents);
+    if (wd < 0) return errno;
+    std::lock_guard<std::mutex> lock(mutex_);
+    paths_[wd] = dir.native();
+    watches_[dir.native()] = wd;
+    return 0;
+}
+
+std::vector<std::string> Watcher::add(const std::filesystem::path& root) {
+    if (fd_ < 0) return {"inotify is not available"};
+
+    // Each directory is watched before it is read, so no change can fall
+    // between its listing and its first event. Listings are trusted only once
+    // the walk has checked them.
+    std::mutex added_mutex;
+    std::vector<std::filesystem::path> added;
+    std::vector<std::string> errors;
+    auto watch = [&](const std::filesystem::path& dir) {
+        int err = watch_directory(dir);
+        std::lock_guard<std::mutex> lock(added_mutex);
+        if (err == 0) {
+            added.push_back(dir);
+        } else {
+            errors.push_back("Cannot watch " + dir.string() + ": " + std::strerror(err));
+        }
+    };
+    watch(root);
+
+    scanner::WalkOptions options;
+    options.cache = &catalog_;
+    options.descend = [&](const scanner::Directory& parent, std::string_view name, const std::string&) {
+        watch(parent.path / name);
+        return true;
+    };
+    auto walk_errors = scanner::walk(root, options,
+        [](size_t, int, const std::shared_ptr<const scanner::Directory>&, std::span<const scanner::DirEntry>) {});
+    errors.insert(errors.end(), walk_errors.begin(), walk_errors.end());
+
+    for (const auto& dir : added) {
+        catalog_.watch(dir);
+    }
+    return errors;
+}
+
+void Watcher::forget_subtree(const std::string& dir) {
+    std::string prefix = dir + "/";
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        if (it->first != dir && !it->first.starts_with(prefix)) {
+            ++it;
+            continue;
+        }
+        catalog_.invalidate(it->first);
+        catalog_.unwatch(it->first);
+        inotify_rm_watch(fd_, it->second);
+        paths_.erase(it->second);
+        it = watches_.erase(it);
+    }
+}
+
+void Watcher::rescan(const std::filesystem::path& dir) {
+    rescans_++;
+    catalog_.invalidate(dir);
+    int dir_fd = scanner::open_directory(dir);
+    if (dir_fd < 0) return;   // gone; its parent's event removes the watch
+
+    struct stat dir_st;
+    std::vector<std::string> subdirectories;
+    scanner::DirectoryReader reader(64 << 10);
+    int err = fstat(dir_fd, &dir_st) != 0 ? errno : reader.read(dir_fd, [&](std::span<scanner::DirEntry> batch) {
+        for (auto& entry : batch) {
+            if (entry.type == scanner::EntryType::Unknown) {
+                entry.type = scanner::stat_type(dir_fd, entry.name.data(), false);
+            }
+            if (entry.type == scanner::EntryType::Directory) subdirectories.emplace_back(entry.name);
+        }
+        catalog_.refresh(dir, dir_st, dir_fd, batch);
+    });
+    if (err == 0) {
+        catalog_.refresh(dir, dir_st, dir_fd, {});
+    } else {
+        catalog_.discard(dir, dir_fd);
+    }
+    close(dir_fd);
+
+    // Directories created or moved in bring their whole subtree along
+    for (const auto& name : subdirectories) {
+        auto child = dir / name;
+        bool known;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            known = watches_.count(child.native()) > 0;
+        }
+        if (!known) add(child);
+    }
+}
+
+void Watcher::run() {
+    alignas(struct inotify_event) char buffer[kEventBufferSize];
+    pollfd fds[2] = {{fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        if (fds[1].revents) return;
+
+        // Drain the queue, then read each touched directory once
+        std::set<std::string> dirty;
+        std::set<std::string> gone;
+        bool overflow = false;
+        for (;;) {
+            ssize_t n = read(fd_, buffer, sizeof(buffer));
+            if (n <= 0) break;
+            for (char* p = buffer; p < buffer + n;) {
+                auto* event = reinterpret_cast<struct inotify_event*>(p);
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->mask & IN_Q_OVERFLOW) {
+                    overflow = true;
+                    continue;
+                }
+                std::string dir;
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    auto it = paths_.find(event->wd);
+                    if (it == paths_.end()) continue;
+                    dir = it->second;
+                }
+                // Moved away, or removed along with the directory
+                if (event->mask & (IN_MOVE_SELF | IN_IGNORED)) {
+                    gone.insert(dir);
+                    continue;
+                }
+                dirty.insert(dir);
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_DELETE | IN_MOVED_FROM)) && event->len > 0) {
+                    gone.insert((std::filesystem::path(dir) / event->name).native());
+                }
+            }
+        }
+
+        for (const auto& dir : gone) {
+            forget_subtree(dir);
+            dirty.erase(dir);
+        }
+        if (overflow) {
+            std::vector<std::string> all;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (const auto& [dir, wd] : watches_) all.push_back(dir);
+            }
+            for (const auto& dir : all) {
+                struct stat st;
+                if (lstat(dir.c_str(), &st) != 0 || !catalog_.current(dir, st)) dirty.insert(dir);
+            }
+        }
+        for (const auto& dir : dirty) {
+            bool known;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                known = watches_.count(dir) > 0;
+            }
+            if (known) rescan(dir);
+        }
+    }
+}
+
+} // namespace watcher
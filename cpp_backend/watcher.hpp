@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "catalog.hpp"
+
+namespace watcher {
+
+// Keeps a catalog's listings current from inotify events, so the directories
+// it watches are served from memory without comparing mtimes, and extension
+// summaries over them hold without a stat.
+//
+// Events are drained in bursts on a background thread. Every directory that
+// gained, lost or renamed an entry in a burst is read again once, and new
+// subdirectories found that way are watched in turn. On a queue overflow the
+// events are lost, so every watched directory is stat'ed and those whose
+// mtime moved are read again.
+class Watcher {
+public:
+    explicit Watcher(catalog::Catalog& catalog);
+    ~Watcher();
+
+    Watcher(const Watcher&) = delete;
+    Watcher& operator=(const Watcher&) = delete;
+
+    // Watches root and every directory below it, first bringing their listings
+    // up to date. Directories that can't be watched (e.g. past the
+    // max_user_watches limit) keep being validated by mtime. Returns errors.
+    std::vector<std::string> add(const std::filesystem::path& root);
+
+    bool ok() const { return fd_ >= 0; }
+    size_t watched() const;
+    // Directories read again because of events so far
+    size_t rescans() const { return rescans_.load(); }
+
+private:
+    int watch_directory(const std::filesystem::path& dir);
+    void forget_subtree(const std::string& dir);
+    void rescan(const std::filesystem::path& dir);
+    void run();
+
+    catalog::Catalog& catalog_;
+    int fd_ = -1;                 // inotify
+    int stop_fd_ = -1;            // eventfd that wakes run() to exit
+
+    mutable std::mutex mutex_;    // guards the two maps
+    std::unordered_map<int, std::string> paths_;      // watch descriptor -> directory
+    std::unordered_map<std::string, int> watches_;    // directory -> watch descriptor
+
+    std::atomic<size_t> rescans_{0};
+    std::thread thread_;
+};
+
+} // namespace watcher
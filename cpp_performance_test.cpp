@@ -0,0 +1,329 @@
+// Backend micro-benchmarks.
+//
+// Build: make cpp_performance_test
+// Usage: ./cpp_performance_test <benchmark> [args...]
+//   scan [counts...]   getdents64 scanner vs std::filesystem::directory_iterator
+//                      (default counts: 10000 100000 1000000)
+//   glob [count]       compiled GlobMatcher vs per-call std::regex (default 1000000 names)
+//   copy [mixes...]    std::filesystem::copy_file loop vs copier vs io_uring BatchCopier
+//                      (mixes: 4k = 4096 x 4KB, 1m = 256 x 1MB, 1g = 1 x 1GB; default all)
+//   hash [threads]     XXH64 from memory and hasher::hash_file on a cached 1GB file,
+//                      as GB/s and GB/s per core (default threads: hardware concurrency)
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <regex>
+#include <system_error>
+#include <thread>
+#include "utils.hpp"
+#include "pattern.hpp"
+#include "copier.hpp"
+#include "uring.hpp"
+#include "hasher.hpp"
+
+namespace fs = std::filesystem;
+using bench_clock = std::chrono::steady_clock;
+
+namespace {
+
+const fs::path kBenchRoot = "/tmp/smartfilecmd_bench";
+
+// Best-of-N wall time in milliseconds
+double time_best_ms(int runs, const std::function<void()>& fn) {
+    double best = 0;
+    for (int i = 0; i < runs; ++i) {
+        auto start = bench_clock::now();
+        fn();
+        double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+// Creates (or reuses) a flat directory holding `count` empty files
+fs::path make_flat_directory(size_t count) {
+    fs::path dir = kBenchRoot / ("flat_" + std::to_string(count));
+    if (fs::exists(dir / ".complete")) {
+        return dir;
+    }
+
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    for (size_t i = 0; i < count; ++i) {
+        std::ofstream(dir / ("file_" + std::to_string(i) + (i % 2 ? ".jpg" : ".txt")));
+    }
+    std::ofstream(dir / ".complete");
+    return dir;
+}
+
+int bench_scan(const std::vector<size_t>& counts) {
+    std::cout << std::left << std::setw(10) << "entries"
+              << std::setw(22) << "directory_iterator"
+              << std::setw(18) << "getdents64"
+              << "speedup" << std::endl;
+
+    for (size_t count : counts) {
+        fs::path dir = make_flat_directory(count);
+        size_t iter_found = 0;
+        size_t scan_found = 0;
+
+        // Baseline is the previous scan_directory implementation
+        double iter_ms = time_best_ms(3, [&] {
+            std::vector<fs::path> files;
+            for (const auto& entry : fs::directory_iterator(dir)) {
+                if (entry.is_regular_file()) files.push_back(entry.path());
+            }
+            iter_found = files.size();
+        });
+        double scan_ms = time_best_ms(3, [&] {
+            scan_found = utils::scan_directory(dir).size();
+        });
+
+        if (iter_found != scan_found) {
+            std::cerr << "Mismatch: iterator found " << iter_found
+                      << ", scanner found " << scan_found << std::endl;
+            return 1;
+        }
+
+        std::cout << std::left << std::setw(10) << count
+                  << std::setw(22) << (std::to_string(iter_ms) + " ms")
+                  << std::setw(18) << (std::to_string(scan_ms) + " ms")
+                  << std::fixed << std::setprecision(2) << iter_ms / scan_ms << "x"
+                  << std::endl;
+    }
+    return 0;
+}
+
+// The regex-per-call glob that matches_glob_pattern used before GlobMatcher
+bool legacy_regex_glob(const std::string& filename, const std::string& pattern) {
+    std::string escaped;
+    for (char c : pattern) {
+        if (c == '*') escaped += ".*";
+        else if (c == '?') escaped += ".";
+        else if (std::string("()[]{}.+^$|\\").find(c) != std::string::npos) escaped += "\\" + std::string(1, c);
+        else escaped += c;
+    }
+    std::regex re(escaped, std::regex::icase);
+    return std::regex_match(filename, re);
+}
+
+int bench_glob(size_t count) {
+    const char* stems[] = {"IMG_", "report-", "backup.", "notes", "DSC"};
+    const char* exts[] = {".jpg", ".JPG", ".txt", ".tar.gz", ".png", ".log"};
+    std::vector<std::string> names;
+    names.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        names.push_back(std::string(stems[i % 5]) + std::to_string(i * 7919 % 100000) + exts[i % 6]);
+    }
+
+    std::cout << std::left << std::setw(20) << "pattern"
+              << std::setw(18) << "std::regex"
+              << std::setw(18) << "GlobMatcher"
+              << "speedup" << std::endl;
+
+    for (std::string pattern : {"*.jpg", "IMG_*9?.jpg", "*-1*.log", "*.tar.*"}) {
+        size_t legacy_hits = 0;
+        size_t glob_hits = 0;
+
+        double legacy_ms = time_best_ms(1, [&] {
+            legacy_hits = 0;
+            for (const auto& name : names) legacy_hits += legacy_regex_glob(name, pattern);
+        });
+        double glob_ms = time_best_ms(3, [&] {
+            utils::GlobMatcher matcher(pattern);
+            glob_hits = 0;
+            for (const auto& name : names) glob_hits += matcher.matches(name);
+        });
+
+        if (legacy_hits != glob_hits) {
+            std::cerr << "Mismatch for " << pattern << ": regex " << legacy_hits
+                      << ", GlobMatcher " << glob_hits << std::endl;
+            return 1;
+        }
+
+        std::cout << std::left << std::setw(20) << pattern
+                  << std::setw(18) << (std::to_string(legacy_ms) + " ms")
+                  << std::setw(18) << (std::to_string(glob_ms) + " ms")
+                  << std::fixed << std::setprecision(1) << legacy_ms / glob_ms << "x"
+                  << std::endl;
+    }
+    return 0;
+}
+
+struct CopyMix {
+    std::string name;
+    size_t files;
+    size_t file_size;
+};
+
+// Creates (or reuses) a source directory for a copy mix, filled with non-zero data
+fs::path make_copy_source(const CopyMix& mix) {
+    fs::path dir = kBenchRoot / ("copy_" + mix.name);
+    if (fs::exists(dir / ".complete")) {
+        return dir;
+    }
+
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string block(1 << 20, '\0');
+    for (size_t i = 0; i < block.size(); ++i) block[i] = static_cast<char>(i * 131 + 7);
+    for (size_t i = 0; i < mix.files; ++i) {
+        std::ofstream out(dir / ("file_" + std::to_string(i)), std::ios::binary);
+        for (size_t left = mix.file_size; left > 0;) {
+            size_t n = std::min(left, block.size());
+            out.write(block.data(), n);
+            left -= n;
+        }
+    }
+    std::ofstream(dir / ".complete");
+    return dir;
+}
+
+int bench_copy(const std::vector<std::string>& names) {
+    const std::vector<CopyMix> mixes = {
+        {"4k", 4096, 4 << 10},
+        {"1m", 256, 1 << 20},
+        {"1g", 1, size_t{1} << 30},
+    };
+    bool have_uring = uring::available();
+    if (!have_uring) {
+        std::cerr << "io_uring unavailable; skipping that column" << std::endl;
+    }
+
+    std::cout << std::left << std::setw(8) << "mix"
+              << std::setw(20) << "fs::copy_file"
+              << std::setw(20) << "copier"
+              << std::setw(20) << "io_uring"
+              << "speedup" << std::endl;
+
+    for (const auto& mix : mixes) {
+        if (!names.empty() && std::find(names.begin(), names.end(), mix.name) == names.end()) continue;
+
+        fs::path src = make_copy_source(mix);
+        fs::path dst = kBenchRoot / ("copy_" + mix.name + "_out");
+        std::vector<fs::path> files;
+        for (size_t i = 0; i < mix.files; ++i) files.push_back(src / ("file_" + std::to_string(i)));
+
+        auto fresh_destination = [&] {
+            fs::remove_all(dst);
+            fs::create_directories(dst);
+        };
+
+        // Baseline is the previous copy_files loop
+        double fs_ms = time_best_ms(3, [&] {
+            fresh_destination();
+            for (const auto& file : files) {
+                fs::copy_file(file, dst / file.filename(), fs::copy_options::overwrite_existing);
+            }
+        });
+        double copier_ms = time_best_ms(3, [&] {
+            fresh_destination();
+            for (const auto& file : files) copier::copy_file(file, dst / file.filename());
+        });
+        double uring_ms = 0;
+        if (have_uring) {
+            uring::BatchCopier ring;
+            std::vector<uring::CopyRequest> requests;
+            for (const auto& file : files) requests.push_back({file, dst / file.filename()});
+            uring_ms = time_best_ms(3, [&] {
+                fresh_destination();
+                for (int err : ring.copy(requests)) {
+                    if (err != 0) throw std::system_error(err, std::generic_category(), "io_uring copy");
+                }
+            });
+        }
+        fs::remove_all(dst);
+
+        std::cout << std::left << std::setw(8) << mix.name
+                  << std::setw(20) << (std::to_string(fs_ms) + " ms")
+                  << std::setw(20) << (std::to_string(copier_ms) + " ms")
+                  << std::setw(20) << (have_uring ? std::to_string(uring_ms) + " ms" : "-")
+                  << std::fixed << std::setprecision(2) << fs_ms / (have_uring ? uring_ms : copier_ms) << "x"
+                  << std::endl;
+    }
+    return 0;
+}
+
+int bench_hash(size_t threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    auto gbps = [](uint64_t bytes, double ms) { return bytes / (ms / 1000.0) / 1e9; };
+
+    // Pure hashing speed of one core, no I/O
+    std::string buffer(256 << 20, '\0');
+    for (size_t i = 0; i < buffer.size(); ++i) buffer[i] = static_cast<char>(i * 131 + 7);
+    volatile uint64_t sink = 0;   // keeps the hashing from being optimized away
+    double memory_ms = time_best_ms(3, [&] { sink = sink ^ hasher::xxh64(buffer.data(), buffer.size()); });
+
+    // Whole-file path, warm page cache: one leaf worker, then one per thread
+    fs::path file = make_copy_source({"1g", 1, size_t{1} << 30}) / "file_0";
+    uint64_t size = fs::file_size(file);
+    hasher::HashOptions options;
+    options.workers = 1;
+    sink = sink ^ hasher::hash_file(file, options);
+    double serial_ms = time_best_ms(3, [&] { sink = sink ^ hasher::hash_file(file, options); });
+    options.workers = threads;
+    double parallel_ms = time_best_ms(3, [&] { sink = sink ^ hasher::hash_file(file, options); });
+
+    std::cout << std::fixed << std::setprecision(2)
+              << std::left << std::setw(28) << "xxh64, memory, 1 core" << gbps(buffer.size(), memory_ms) << " GB/s\n"
+              << std::setw(28) << "hash_file, 1 worker" << gbps(size, serial_ms) << " GB/s\n"
+              << std::setw(28) << ("hash_file, " + std::to_string(threads) + " workers")
+              << gbps(size, parallel_ms) << " GB/s (" << gbps(size, parallel_ms) / threads << " GB/s per core)"
+              << std::endl;
+    return 0;
+}
+
+std::vector<size_t> parse_counts(int argc, char** argv, int first, std::vector<size_t> defaults) {
+    if (argc <= first) return defaults;
+    std::vector<size_t> counts;
+    for (int i = first; i < argc; ++i) {
+        counts.push_back(std::stoul(argv[i]));
+    }
+    return counts;
+}
+
+void usage() {
+    std::cerr << "Usage: cpp_performance_test <benchmark> [args...]\n"
+              << "  scan [counts...]   getdents64 scanner vs directory_iterator\n"
+              << "  glob [count]       GlobMatcher vs per-call std::regex\n"
+              << "  copy [mixes...]    fs::copy_file vs copier vs io_uring (4k, 1m, 1g)\n"
+              << "  hash [threads]     XXH64 and hash_file throughput in GB/s\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    std::string benchmark = argv[1];
+    try {
+        if (benchmark == "scan") {
+            return bench_scan(parse_counts(argc, argv, 2, {10000, 100000, 1000000}));
+        }
+        if (benchmark == "glob") {
+            return bench_glob(parse_counts(argc, argv, 2, {1000000})[0]);
+        }
+        if (benchmark == "copy") {
+            return bench_copy(std::vector<std::string>(argv + 2, argv + argc));
+        }
+        if (benchmark == "hash") {
+            return bench_hash(parse_counts(argc, argv, 2, {0})[0]);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Benchmark failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    usage();
+    return 1;
+}
@@ -6,6 +6,7 @@ Main command-line interface for the application.
 
 import sys
 import typer
+from typing import List, Optional
 from pathlib import Path
 from gemini_parser import GeminiParser
 from utils import validate_command, send_command_to_backend, format_result
@@ -22,7 +23,19 @@ def main(
     dry_run: bool = typer.Option(False, "--dry-run", "-d", help="Preview mode - show what would be done"),
     force: bool = typer.Option(False, "--force", "-f", help="Skip confirmation prompts"),
     recursive: bool = typer.Option(False, "--recursive", "-r", help="Scan subdirectories recursively"),
-    verbose: bool = typer.Option(False, "--verbose", "-v", help="Show detailed output")
+    verbose: bool = typer.Option(False, "--verbose", "-v", help="Show detailed output"),
+    exclude: List[str] = typer.Option([], "--exclude", "-e", help="Glob to skip (repeatable, e.g. node_modules)"),
+    ignore_files: bool = typer.Option(False, "--ignore-files", help="Honor .gitignore/.smartfileignore files"),
+    index: bool = typer.Option(False, "--index", help="Reuse the on-disk index of unchanged directories and refresh it"),
+    min_size: Optional[str] = typer.Option(None, "--min-size", help="Only files at least this large (e.g. 100MB)"),
+    max_size: Optional[str] = typer.Option(None, "--max-size", help="Only files at most this large (e.g. 1GB)"),
+    older_than: Optional[str] = typer.Option(None, "--older-than", help="Only files modified longer ago than this (e.g. 30d)"),
+    newer_than: Optional[str] = typer.Option(None, "--newer-than", help="Only files modified within this period (e.g. 12h)"),
+    verify: bool = typer.Option(False, "--verify", help="Compare cross-filesystem moves before removing the source"),
+    sync: bool = typer.Option(False, "--sync", help="Copy only files that are new or changed at the destination"),
+    checksum: bool = typer.Option(False, "--checksum", help="With --sync, compare contents instead of size and mtime"),
+    delta: bool = typer.Option(False, "--delta", help="Update existing destination files in place, rewriting only changed blocks"),
+    dedupe: Optional[str] = typer.Option(None, "--dedupe", help="Replace duplicates found with 'hardlink' or 'reflink'")
 ):
     """
     SmartFileCmd - Natural Language File Manager
@@ -61,9 +74,23 @@ def main(
             'dry_run': dry_run,
             'force': force,
             'recursive': recursive,
-            'verbose': verbose
+            'verbose': verbose,
+            'exclude': exclude,
+            'ignore_files': ignore_files,
+            'index': index,
+            'verify': verify,
+            'sync': sync,
+            'checksum': checksum,
+            'delta': delta
         })
         
+        # Metadata predicates and the dedupe mode are only sent when given
+        for key, value in [('min_size', min_size), ('max_size', max_size),
+                           ('older_than', older_than), ('newer_than', newer_than),
+                           ('dedupe', dedupe)]:
+            if value is not None:
+                parsed_command[key] = value
+        
         # Execute command
         if verbose:
             typer.echo("🚀 Executing command...")
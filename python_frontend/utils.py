@@ -4,6 +4,8 @@ Utility functions for SmartFileCmd Python frontend.
 """
 
 import json
+import socket
+import struct
 import subprocess
 import os
 from pathlib import Path
@@ -21,15 +23,77 @@ def validate_command(command: Dict[str, Any]) -> bool:
     
     if action in ['move', 'copy']:
         return 'source' in command and 'destination' in command
-    elif action == 'delete':
+    elif action in ['delete', 'hash', 'find_duplicates', 'index']:
         return 'source' in command
+    elif action == 'delete_tree':
+        return 'source' in command and bool(command.get('pattern'))
     elif action == 'create_folder':
         return 'destination' in command
     else:
         return False
 
+# Returned by send_command_to_server when no server is listening
+NO_SERVER = object()
+
+def get_socket_path() -> str:
+    """Socket a `smartfilecmd --serve` listens on (same rules as the backend)."""
+    if os.environ.get('SMARTFILECMD_SOCKET'):
+        return os.environ['SMARTFILECMD_SOCKET']
+    if os.environ.get('XDG_RUNTIME_DIR'):
+        return os.path.join(os.environ['XDG_RUNTIME_DIR'], 'smartfilecmd.sock')
+    return f"/tmp/smartfilecmd-{os.getuid()}.sock"
+
+def send_command_to_server(command: Dict[str, Any]) -> Any:
+    """Send command to a running backend server; NO_SERVER if there is none."""
+    # The server resolves relative paths against its own working directory
+    command = dict(command)
+    for key in ('source', 'destination'):
+        if command.get(key):
+            command[key] = expand_path(command[key])
+    
+    try:
+        sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        sock.connect(get_socket_path())
+    except OSError:
+        return NO_SERVER
+    
+    # The fallback path is in world-writable /tmp: only talk to our own server
+    try:
+        creds = sock.getsockopt(socket.SOL_SOCKET, socket.SO_PEERCRED, struct.calcsize('3i'))
+        _, uid, _ = struct.unpack('3i', creds)
+    except OSError:
+        uid = None
+    if uid != os.getuid():
+        sock.close()
+        print(f"Ignoring backend server at {get_socket_path()}: not owned by this user")
+        return NO_SERVER
+    
+    # Once connected the command may have run, so failures are not retried
+    try:
+        with sock:
+            sock.settimeout(300)  # 5 minute timeout, like the process path
+            sock.sendall(json.dumps(command).encode() + b"\n")
+            response = b""
+            while not response.endswith(b"\n"):
+                chunk = sock.recv(65536)
+                if not chunk:
+                    break
+                response += chunk
+        return json.loads(response)
+    except socket.timeout:
+        print("Backend operation timed out")
+        return None
+    except (OSError, json.JSONDecodeError) as e:
+        print(f"Failed to communicate with backend server: {e}")
+        return None
+
 def send_command_to_backend(command: Dict[str, Any]) -> Optional[Dict[str, Any]]:
     """Send command to C++ backend and return result."""
+    # A running `smartfilecmd --serve` answers without starting a process
+    result = send_command_to_server(command)
+    if result is not NO_SERVER:
+        return result
+    
     try:
         # Get backend path
         backend_path = get_cpp_backend_path()
@@ -129,6 +193,15 @@ def format_result(result: Dict[str, Any], verbose: bool = False) -> str:
     
     output.append(f"✅ {message}")
     
+    # One line per file, like sha256sum
+    for entry in result.get('digests', []):
+        output.append(f"{entry['digest']}  {entry['path']}")
+    
+    # Blank line between groups; the first path is the one that is kept
+    for group in result.get('duplicate_groups', []):
+        output.append("")
+        output.extend(f"  {path}" for path in group)
+    
     # Show errors if any
     errors = result.get('errors', [])
     if errors and verbose:
@@ -143,7 +216,7 @@ def confirm_destructive_operation(command: Dict[str, Any]) -> bool:
     action = command.get('action', '')
     source = command.get('source', '')
     
-    if action in ['delete']:
+    if action in ['delete', 'delete_tree']:
         print(f"\n⚠️  WARNING: This will DELETE files from '{source}'")
         response = input("Are you sure you want to continue? (yes/no): ").lower().strip()
         return response in ['yes', 'y']
@@ -164,6 +237,8 @@ def format_dry_run(command: Dict[str, Any]) -> str:
     
     if action == 'delete':
         return f"Would delete files matching '{pattern}' from '{source}'"
+    elif action == 'delete_tree':
+        return f"Would delete directories matching '{pattern}' under '{source}'"
     elif action in ['move', 'copy']:
         return f"Would {action} files matching '{pattern}' from '{source}' to '{destination}'"
     elif action == 'create_folder':
@@ -1,10 +1,36 @@
 #include <iostream>
 #include <cassert>
 #include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
 #include <string>
 #include <vector>
+#include <optional>
+#include <set>
 #include "../cpp_backend/utils.hpp"
+#include "../cpp_backend/bounded_queue.hpp"
 #include "../cpp_backend/actions.hpp"
+#include "../cpp_backend/pattern.hpp"
+#include "../cpp_backend/ignore.hpp"
+#include "../cpp_backend/metadata.hpp"
+#include "../cpp_backend/copier.hpp"
+#include "../cpp_backend/executor.hpp"
+#include "../cpp_backend/uring.hpp"
+#include "../cpp_backend/hasher.hpp"
+#include "../cpp_backend/remover.hpp"
+#include "../cpp_backend/catalog.hpp"
+#include "../cpp_backend/watcher.hpp"
+#include "../cpp_backend/server.hpp"
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 // Simple test framework
 #define TEST(name) void test_##name()
@@ -79,6 +105,123 @@ TEST(scan_directory) {
     std::cout << "✓ scan_directory tests passed" << std::endl;
 }
 
+TEST(scan_directory_recursive) {
+    std::cout << "Testing scan_directory_recursive..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_recursive";
+    std::filesystem::create_directories(test_dir / "a" / "b");
+    std::filesystem::create_directories(test_dir / "c");
+    
+    std::ofstream(test_dir / "root.txt").close();
+    std::ofstream(test_dir / "a" / "one.txt").close();
+    std::ofstream(test_dir / "a" / "b" / "two.txt").close();
+    std::ofstream(test_dir / "c" / "three.jpg").close();
+    
+    // Same result regardless of worker count
+    for (size_t threads : {1, 4}) {
+        std::vector<std::string> errors;
+        auto files = utils::scan_directory_recursive(test_dir, threads, &errors);
+        ASSERT_EQ(files.size(), 4);
+        ASSERT_TRUE(errors.empty());
+    }
+    
+    // keep_open hands out directory descriptors that outlive the walk
+    scanner::WalkOptions options;
+    options.keep_open = true;
+    std::mutex kept_mutex;
+    std::vector<std::shared_ptr<const scanner::Directory>> kept;
+    scanner::walk(test_dir, options, [&](size_t, int, const std::shared_ptr<const scanner::Directory>& dir,
+                                         std::span<const scanner::DirEntry>) {
+        std::lock_guard<std::mutex> lock(kept_mutex);
+        kept.push_back(dir);
+    });
+    ASSERT_EQ(kept.size(), 4);
+    for (const auto& dir : kept) {
+        struct stat st;
+        ASSERT_TRUE(dir->dir_fd() >= 0);
+        ASSERT_TRUE(fstat(dir->dir_fd(), &st) == 0 && S_ISDIR(st.st_mode));
+    }
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ scan_directory_recursive tests passed" << std::endl;
+}
+
+TEST(stream_files) {
+    std::cout << "Testing stream_files..." << std::endl;
+    
+    // Far more batches than the queue holds: 200 small directories plus one
+    // large enough to be split into several batches
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_stream";
+    std::filesystem::remove_all(test_dir);
+    std::set<std::string> expected;
+    for (int d = 0; d < 200; ++d) {
+        auto dir = test_dir / ("d" + std::to_string(d));
+        std::filesystem::create_directories(dir);
+        for (int f = 0; f < 3; ++f) {
+            std::ofstream(dir / ("f" + std::to_string(f) + ".txt")) << f;
+            expected.insert((dir / ("f" + std::to_string(f) + ".txt")).string());
+        }
+        std::ofstream(dir / "skip.log") << d;
+    }
+    std::filesystem::create_directories(test_dir / "big");
+    for (size_t f = 0; f < 2 * utils::kStreamBatchSize + 100; ++f) {
+        std::ofstream(test_dir / "big" / ("g" + std::to_string(f) + ".txt")).close();
+        expected.insert((test_dir / "big" / ("g" + std::to_string(f) + ".txt")).string());
+    }
+    
+    utils::StreamOptions options;
+    options.recursive = true;
+    options.threads = 4;
+    utils::PatternMatcher matcher(".txt");
+    std::vector<std::string> delivered;
+    size_t batches = 0;
+    auto stats = utils::stream_files(test_dir, options, matcher, {}, [&](utils::FileBatch& batch) {
+        // A slow consumer lets the walkers fill the queue and block on it
+        if (batches++ < 4) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_TRUE(batch.names.size() <= utils::kStreamBatchSize);
+        for (const auto& name : batch.names) delivered.push_back((batch.dir->path / name).string());
+    });
+    ASSERT_TRUE(batches > utils::kStreamQueueCapacity);
+    ASSERT_EQ(delivered.size(), expected.size());
+    ASSERT_EQ(std::set<std::string>(delivered.begin(), delivered.end()), expected);
+    ASSERT_EQ(stats.files_matched, expected.size());
+    ASSERT_EQ(stats.files_scanned, expected.size() + 200);
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ stream_files tests passed" << std::endl;
+}
+
+TEST(bounded_queue) {
+    std::cout << "Testing BoundedQueue..." << std::endl;
+    
+    // Closing wakes a consumer waiting on an empty queue
+    utils::BoundedQueue<int> empty(4);
+    std::optional<int> popped = 0;
+    std::thread consumer([&] { popped = empty.pop(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    empty.close();
+    consumer.join();
+    ASSERT_FALSE(popped.has_value());
+    
+    // ... and a producer waiting on a full one; what was queued still drains
+    utils::BoundedQueue<int> full(2);
+    ASSERT_TRUE(full.push(1));
+    ASSERT_TRUE(full.push(2));
+    bool pushed = true;
+    std::thread producer([&] { pushed = full.push(3); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    full.close();
+    producer.join();
+    ASSERT_FALSE(pushed);
+    ASSERT_EQ(*full.pop(), 1);
+    ASSERT_EQ(*full.pop(), 2);
+    ASSERT_FALSE(full.pop().has_value());
+    
+    std::cout << "✓ BoundedQueue tests passed" << std::endl;
+}
+
 TEST(matches_pattern) {
     std::cout << "Testing matches_pattern..." << std::endl;
     
@@ -99,6 +242,910 @@ TEST(matches_pattern) {
     std::cout << "✓ matches_pattern tests passed" << std::endl;
 }
 
+TEST(glob_matcher) {
+    std::cout << "Testing GlobMatcher..." << std::endl;
+    
+    utils::GlobMatcher star("*.jpg");
+    ASSERT_TRUE(star.matches("photo.jpg"));
+    ASSERT_TRUE(star.matches("PHOTO.JPG"));
+    ASSERT_FALSE(star.matches("photo.jpeg"));
+    ASSERT_FALSE(star.matches("dir/photo.jpg"));
+    
+    utils::GlobMatcher question("file?.txt");
+    ASSERT_TRUE(question.matches("file1.txt"));
+    ASSERT_FALSE(question.matches("file10.txt"));
+    
+    utils::GlobMatcher klass("[a-c]*.[!o]");
+    ASSERT_TRUE(klass.matches("b_main.c"));
+    ASSERT_FALSE(klass.matches("d_main.c"));
+    ASSERT_FALSE(klass.matches("a_main.o"));
+    
+    utils::GlobMatcher globstar("src/**/*.o");
+    ASSERT_TRUE(globstar.matches("src/main.o"));
+    ASSERT_TRUE(globstar.matches("src/a/b/main.o"));
+    ASSERT_FALSE(globstar.matches("lib/main.o"));
+    
+    // "**/" matches whole path components or nothing
+    utils::GlobMatcher components("src/**/x");
+    ASSERT_TRUE(components.matches("src/x"));
+    ASSERT_TRUE(components.matches("src/a/b/x"));
+    ASSERT_FALSE(components.matches("src/ax"));
+    ASSERT_FALSE(components.matches("srcx"));
+    ASSERT_FALSE(components.matches("src/a/bx"));
+    ASSERT_TRUE(utils::GlobMatcher("**/x").matches("x"));
+    ASSERT_FALSE(utils::GlobMatcher("**/x").matches("ax"));
+    ASSERT_FALSE(utils::GlobMatcher("a**/x").matches("ax"));
+    ASSERT_TRUE(utils::GlobMatcher("a**/x").matches("ab/x"));
+    
+    // Path patterns prune directories that can't lead to a match
+    utils::PatternMatcher build_objects("src/**/build/*.o");
+    ASSERT_TRUE(build_objects.is_path_pattern());
+    ASSERT_TRUE(build_objects.may_match_under("src"));
+    ASSERT_TRUE(build_objects.may_match_under("src/a/b"));
+    ASSERT_FALSE(build_objects.may_match_under("lib"));
+    ASSERT_TRUE(build_objects.matches("src/a/build/x.o"));
+    ASSERT_FALSE(build_objects.matches("src/a/x.o"));
+    
+    // Final extensions let cached walks skip subtrees
+    ASSERT_EQ(build_objects.final_extensions(), std::vector<std::string>{"o"});
+    ASSERT_EQ(utils::PatternMatcher(".JPG,.tar.gz").final_extensions(), (std::vector<std::string>{"jpg", "gz"}));
+    ASSERT_TRUE(utils::PatternMatcher("*.[ch]").final_extensions().empty());
+    ASSERT_TRUE(utils::PatternMatcher("").final_extensions().empty());
+    
+    // Long patterns spill into multiple state words
+    std::string long_pattern = std::string(100, 'a') + "*";
+    utils::GlobMatcher long_glob(long_pattern);
+    ASSERT_TRUE(long_glob.matches(std::string(100, 'a') + "tail"));
+    ASSERT_FALSE(long_glob.matches(std::string(99, 'a')));
+    utils::GlobMatcher long_globstar(std::string(61, 'a') + "/**/x");
+    ASSERT_TRUE(long_globstar.matches(std::string(61, 'a') + "/x"));
+    ASSERT_TRUE(long_globstar.matches(std::string(61, 'a') + "/b/x"));
+    ASSERT_FALSE(long_globstar.matches(std::string(61, 'a') + "/bx"));
+    
+    std::cout << "✓ GlobMatcher tests passed" << std::endl;
+}
+
+TEST(extension_set) {
+    std::cout << "Testing ExtensionSet..." << std::endl;
+    
+    utils::ExtensionSet set(".jpg,.jpeg, .PNG,.heic,.webp,.backup-archive");
+    ASSERT_EQ(set.size(), 6);
+    ASSERT_TRUE(set.matches("photo.jpg"));
+    ASSERT_TRUE(set.matches("PHOTO.JPEG"));
+    ASSERT_TRUE(set.matches("a.png"));
+    ASSERT_TRUE(set.matches(".webp"));
+    ASSERT_TRUE(set.matches("old.Backup-Archive"));
+    ASSERT_FALSE(set.matches("photo.jpg.txt"));
+    ASSERT_FALSE(set.matches("jpg"));
+    ASSERT_FALSE(set.matches(""));
+    
+    // Batched kernel agrees with the scalar path
+    std::vector<scanner::DirEntry> batch = {
+        {"x.WebP", scanner::EntryType::Regular},
+        {"x.gif", scanner::EntryType::Regular},
+        {"longer_name.heic", scanner::EntryType::Regular},
+    };
+    uint8_t out[3];
+    set.match_batch(batch, out);
+    ASSERT_TRUE(out[0] && !out[1] && out[2]);
+    
+    // Command patterns accept extension lists
+    ASSERT_TRUE(utils::matches_pattern("IMG_1.JPG", ".jpg,.png"));
+    ASSERT_FALSE(utils::matches_pattern("IMG_1.gif", ".jpg,.png"));
+    
+    std::cout << "✓ ExtensionSet tests passed" << std::endl;
+}
+
+TEST(ignore_list) {
+    std::cout << "Testing IgnoreList..." << std::endl;
+    
+    auto root = std::make_shared<utils::IgnoreList>(nullptr, "");
+    root->add_rule("node_modules");
+    root->add_rule("build/");
+    root->add_rule("/docs/*.tmp");
+    ASSERT_TRUE(root->ignored("a/b", "node_modules", true));
+    ASSERT_TRUE(root->ignored("", "build", true));
+    ASSERT_FALSE(root->ignored("", "build", false));
+    ASSERT_TRUE(root->ignored("docs", "x.tmp", false));
+    ASSERT_FALSE(root->ignored("src/docs", "x.tmp", false));
+    
+    // Deeper levels override their parents; '!' re-includes
+    auto nested = std::make_shared<utils::IgnoreList>(root, "src");
+    nested->add_rule("*.log");
+    nested->add_rule("!keep.log");
+    ASSERT_TRUE(nested->ignored("src/a", "debug.log", false));
+    ASSERT_FALSE(nested->ignored("src/a", "keep.log", false));
+    ASSERT_TRUE(nested->ignored("src", "node_modules", true));
+    
+    // A rule too long to compile is reported by the walk, not thrown from it
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_ignore";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir);
+    std::ofstream(test_dir / ".gitignore") << "*.log\n" << std::string(2000, 'x') << "\n";
+    std::ofstream(test_dir / "a.log") << "a";
+    std::ofstream(test_dir / "b.txt") << "b";
+    scanner::WalkOptions options;
+    options.ignore_files = utils::kIgnoreFileNames;
+    std::vector<std::string> names;
+    std::mutex names_mutex;
+    auto errors = scanner::walk(test_dir, options,
+        [&](size_t, int, const std::shared_ptr<const scanner::Directory>& dir, std::span<const scanner::DirEntry> batch) {
+            std::lock_guard<std::mutex> lock(names_mutex);
+            for (const auto& entry : batch) {
+                if (!dir->ignore || !dir->ignore->ignored(dir->rel, entry.name, false)) names.emplace_back(entry.name);
+            }
+        });
+    ASSERT_EQ(errors.size(), 1);
+    ASSERT_TRUE(errors[0].find(".gitignore:2:") != std::string::npos);
+    ASSERT_TRUE(std::find(names.begin(), names.end(), "a.log") == names.end());
+    ASSERT_TRUE(std::find(names.begin(), names.end(), "b.txt") != names.end());
+    
+    // An ignore file over the size cap is reported and none of it applied,
+    // rather than its first megabyte
+    std::ofstream(test_dir / ".gitignore", std::ios::trunc) << "*.log\n" << std::string(2 << 20, '#');
+    int dir_fd = scanner::open_directory(test_dir);
+    errors.clear();
+    auto loaded = utils::IgnoreList::load(dir_fd, {".gitignore"}, nullptr, "", errors);
+    close(dir_fd);
+    ASSERT_TRUE(loaded == nullptr);
+    ASSERT_EQ(errors.size(), 1);
+    ASSERT_TRUE(errors[0].find("larger than 1 MB") != std::string::npos);
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ IgnoreList tests passed" << std::endl;
+}
+
+TEST(parse_size_and_duration) {
+    std::cout << "Testing parse_size/parse_duration..." << std::endl;
+    
+    ASSERT_EQ(*utils::parse_size("1048576"), 1048576u);
+    ASSERT_EQ(*utils::parse_size("100MB"), 100u * 1024 * 1024);
+    ASSERT_EQ(*utils::parse_size("4 KiB"), 4096u);
+    ASSERT_EQ(*utils::parse_size("1.5g"), 1536u * 1024 * 1024);
+    ASSERT_FALSE(utils::parse_size("lots").has_value());
+    ASSERT_FALSE(utils::parse_size("10 parsecs").has_value());
+    ASSERT_FALSE(utils::parse_size("1e30T").has_value());
+    ASSERT_FALSE(utils::parse_size("16777216T").has_value());
+    ASSERT_EQ(*utils::parse_size("16777215T"), 16777215ull << 40);
+    
+    ASSERT_EQ(*utils::parse_duration("30d"), 30 * 86400);
+    ASSERT_EQ(*utils::parse_duration("12h"), 12 * 3600);
+    ASSERT_EQ(*utils::parse_duration("90"), 90);
+    ASSERT_FALSE(utils::parse_duration("-5d").has_value());
+    ASSERT_FALSE(utils::parse_duration("1e300w").has_value());
+    
+    std::cout << "✓ parse_size/parse_duration tests passed" << std::endl;
+}
+
+TEST(copier_copy_file) {
+    std::cout << "Testing copier::copy_file..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_copier";
+    std::filesystem::create_directories(test_dir);
+    
+    std::string payload(3 * 1024 * 1024 + 17, 'x');
+    std::ofstream(test_dir / "src.bin") << payload;
+    std::ofstream(test_dir / "dst.bin") << "stale contents that are longer than nothing";
+    
+    // Overwrites the destination and lands the exact bytes, whatever method won
+    copier::copy_file(test_dir / "src.bin", test_dir / "dst.bin");
+    ASSERT_EQ(std::filesystem::file_size(test_dir / "dst.bin"), payload.size());
+    
+    // Split into 1MB ranges copied by several threads, tail range included
+    for (size_t i = 0; i < payload.size(); ++i) payload[i] = static_cast<char>('a' + i % 23);
+    std::ofstream(test_dir / "src.bin", std::ios::trunc) << payload;
+    copier::CopyOptions parallel;
+    parallel.parallel_threshold = 1;
+    parallel.range_size = 1 << 20;
+    copier::copy_file(test_dir / "src.bin", test_dir / "dst.bin", parallel);
+    std::ifstream copied(test_dir / "dst.bin", std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(copied)), std::istreambuf_iterator<char>());
+    ASSERT_TRUE(contents == payload);
+    ASSERT_TRUE(copier::same_contents(test_dir / "src.bin", test_dir / "dst.bin"));
+    
+    // One flipped byte past the first buffer is caught
+    {
+        std::fstream patch(test_dir / "dst.bin", std::ios::in | std::ios::out | std::ios::binary);
+        patch.seekp(2 * 1024 * 1024 + 3);
+        patch.put('#');
+    }
+    ASSERT_TRUE(!copier::same_contents(test_dir / "src.bin", test_dir / "dst.bin"));
+    
+    // Delta mode patches the same file in place, then follows a shrinking source
+    copier::CopyOptions delta = parallel;
+    delta.delta = true;
+    auto inode = [&] { struct stat st; stat((test_dir / "dst.bin").c_str(), &st); return st.st_ino; };
+    auto before = inode();
+    ASSERT_TRUE(copier::copy_file(test_dir / "src.bin", test_dir / "dst.bin", delta) == copier::Method::Delta);
+    ASSERT_EQ(inode(), before);
+    ASSERT_TRUE(copier::same_contents(test_dir / "src.bin", test_dir / "dst.bin"));
+    std::filesystem::resize_file(test_dir / "src.bin", 1024 * 1024 + 5);
+    copier::copy_file(test_dir / "src.bin", test_dir / "dst.bin", delta);
+    ASSERT_TRUE(copier::same_contents(test_dir / "src.bin", test_dir / "dst.bin"));
+    payload.resize(1024 * 1024 + 5);
+    
+    // Copying a file onto itself must not truncate it
+    bool threw = false;
+    try {
+        copier::copy_file(test_dir / "src.bin", test_dir / "src.bin");
+    } catch (const std::filesystem::filesystem_error&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    ASSERT_EQ(std::filesystem::file_size(test_dir / "src.bin"), payload.size());
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ copier::copy_file tests passed" << std::endl;
+}
+
+TEST(uring_batch_copier) {
+    std::cout << "Testing uring::BatchCopier..." << std::endl;
+    
+    if (!uring::available()) {
+        std::cout << "  (io_uring unavailable, skipped)" << std::endl;
+        return;
+    }
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_uring";
+    std::filesystem::create_directories(test_dir / "out");
+    
+    // Small, empty and multi-buffer files in one batch, plus a missing source
+    std::vector<std::string> payloads = {"tiny", "", std::string(300 * 1024 + 5, 'q')};
+    std::vector<uring::CopyRequest> requests;
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        std::string name = "file" + std::to_string(i);
+        std::ofstream(test_dir / name) << payloads[i];
+        requests.push_back({test_dir / name, test_dir / "out" / name});
+    }
+    requests.push_back({test_dir / "missing", test_dir / "out" / "missing"});
+    
+    uring::BatchCopier ring(8, 64 * 1024);
+    std::vector<int> errors = ring.copy(requests);
+    ASSERT_EQ(errors.size(), requests.size());
+    for (size_t i = 0; i < payloads.size(); ++i) {
+        ASSERT_EQ(errors[i], 0);
+        std::ifstream copied(requests[i].dst, std::ios::binary);
+        std::string contents((std::istreambuf_iterator<char>(copied)), std::istreambuf_iterator<char>());
+        ASSERT_TRUE(contents == payloads[i]);
+    }
+    ASSERT_EQ(errors.back(), ENOENT);
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ uring::BatchCopier tests passed" << std::endl;
+}
+
+TEST(uring_metadata_batch) {
+    std::cout << "Testing uring::MetadataBatch..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_metadata";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir);
+    std::ofstream(test_dir / "a.txt") << "a";
+    
+    // Same results through the ring and through plain syscalls
+    for (unsigned depth : {uring::MetadataBatch::kDefaultQueueDepth, 0u}) {
+        uring::MetadataBatch batch(depth);
+        int dir = open(test_dir.c_str(), O_RDONLY | O_DIRECTORY);
+        
+        struct statx st;
+        batch.mkdir(dir, "x");
+        batch.link();
+        batch.mkdir(dir, "x/y");
+        batch.rename(dir, "a.txt", dir, "x/y/b.txt");
+        batch.statx(dir, "missing", 0, STATX_SIZE, &st);
+        std::vector<int> results = batch.run();
+        ASSERT_EQ(results.size(), 4);
+        ASSERT_EQ(results[0], 0);
+        ASSERT_EQ(results[1], 0);
+        ASSERT_EQ(results[3], ENOENT);
+        ASSERT_TRUE(std::filesystem::exists(test_dir / "x" / "y"));
+        
+        // Links only order ops; a failure doesn't cancel what follows
+        batch.mkdir(dir, "x");
+        batch.link();
+        batch.unlink(dir, "x/y", AT_REMOVEDIR);
+        results = batch.run();
+        ASSERT_EQ(results[0], EEXIST);
+        ASSERT_EQ(results[1], ENOTEMPTY);
+        
+        // Put things back for the next round
+        batch.statx(dir, "x/y/b.txt", 0, STATX_SIZE, &st);
+        batch.rename(dir, "x/y/b.txt", dir, "a.txt");
+        batch.unlink(dir, "x/y", AT_REMOVEDIR);
+        batch.unlink(dir, "x", AT_REMOVEDIR);
+        results = batch.run();
+        ASSERT_EQ(results[0], 0);
+        ASSERT_EQ(st.stx_size, 1);
+        close(dir);
+    }
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "a.txt"));
+    ASSERT_TRUE(!std::filesystem::exists(test_dir / "x"));
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ uring::MetadataBatch tests passed" << std::endl;
+}
+
+TEST(executor_device_limits) {
+    std::cout << "Testing executor::Executor..." << std::endl;
+    
+    // Device 0 is never a real block device, so it gets the fast limit
+    executor::ExecutorOptions options;
+    options.threads = 8;
+    options.queue_capacity = 4;
+    options.device_limit = 3;
+    executor::Executor pool(options);
+    
+    std::atomic<int> running{0};
+    std::atomic<int> peak{0};
+    std::atomic<int> done{0};
+    for (int i = 0; i < 40; ++i) {
+        pool.submit({0}, [&] {
+            int now = ++running;
+            int seen = peak.load();
+            while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+            ++done;
+        });
+    }
+    pool.wait();
+    ASSERT_EQ(done.load(), 40);
+    ASSERT_TRUE(peak.load() <= 3);
+    
+    // A stray exception surfaces from wait()
+    pool.submit({}, [] { throw std::runtime_error("boom"); });
+    bool threw = false;
+    try {
+        pool.wait();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    ASSERT_TRUE(threw);
+    
+    // for_each_index reports the code the work returned, not whatever errno holds
+    int err = executor::for_each_index(100, 4, [](uint64_t index) {
+        errno = 0;
+        return index == 37 ? EIO : 0;
+    });
+    ASSERT_EQ(err, EIO);
+    
+    std::cout << "✓ executor::Executor tests passed" << std::endl;
+}
+
+TEST(hasher_digests) {
+    std::cout << "Testing hasher..." << std::endl;
+    
+    // Reference XXH64 values
+    ASSERT_EQ(hasher::xxh64("", 0), 0xEF46DB3751D8E999ULL);
+    ASSERT_EQ(hasher::xxh64("abc", 3), 0x44BC2CF5AD770999ULL);
+    std::string text = "Nobody inspects the spammish repetition";
+    ASSERT_EQ(hasher::xxh64(text.data(), text.size()), 0xFBCEA83C8A378BF1ULL);
+    ASSERT_EQ(hasher::to_hex(0xFBCEA83C8A378BF1ULL), "fbcea83c8a378bf1");
+    
+    // Streaming in odd pieces gives the one-shot digest
+    std::string data(3 * 1024 * 1024 + 1000, '\0');
+    for (size_t i = 0; i < data.size(); ++i) data[i] = static_cast<char>(i * 2654435761u >> 13);
+    hasher::Xxh64 state;
+    for (size_t offset = 0, step = 1; offset < data.size(); offset += step, step = step * 3 % 4099 + 1) {
+        state.update(data.data() + offset, std::min(step, data.size() - offset));
+    }
+    ASSERT_EQ(state.digest(), hasher::xxh64(data.data(), data.size()));
+    
+    std::filesystem::path file = "/tmp/smartfilecmd_test_hash.bin";
+    std::ofstream(file, std::ios::binary) << data;
+    ASSERT_EQ(hasher::hash_file(file), hasher::xxh64(data.data(), data.size()));
+    
+    // Tree digests depend on the leaf size only, not on the thread count
+    hasher::HashOptions tree;
+    tree.leaf_size = 1 << 20;
+    tree.workers = 1;
+    uint64_t serial = hasher::hash_file(file, tree);
+    tree.workers = 4;
+    ASSERT_EQ(hasher::hash_file(file, tree), serial);
+    ASSERT_NE(serial, hasher::xxh64(data.data(), data.size()));
+    
+    // A changed byte in the last leaf changes the digest
+    data[data.size() - 10] ^= 1;
+    std::ofstream(file, std::ios::binary | std::ios::trunc) << data;
+    ASSERT_NE(hasher::hash_file(file, tree), serial);
+    
+    std::filesystem::remove(file);
+    
+    std::cout << "✓ hasher tests passed" << std::endl;
+}
+
+TEST(copy_sync) {
+    std::cout << "Testing incremental copy..." << std::endl;
+    
+    std::filesystem::path src = "/tmp/smartfilecmd_test_sync_src";
+    std::filesystem::path dst = "/tmp/smartfilecmd_test_sync_dst";
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(dst);
+    std::filesystem::create_directories(src);
+    std::filesystem::create_directories(dst);
+    for (const char* name : {"a.txt", "b.txt", "c.txt"}) {
+        std::ofstream(src / name) << name;
+    }
+    
+    for (bool use_io_uring : {false, true}) {
+        actions::Command cmd = {"copy", ".txt", src.string(), dst.string()};
+        cmd.sync = true;
+        cmd.use_io_uring = use_io_uring;
+        auto result = actions::copy_files(cmd);
+        ASSERT_TRUE(result.success);
+        ASSERT_EQ(result.files_affected, use_io_uring ? 0 : 3);
+        
+        // Same size, new mtime: copied again; untouched files are skipped
+        std::ofstream(src / "b.txt") << "B.txt";
+        std::filesystem::last_write_time(src / "b.txt", std::filesystem::last_write_time(src / "b.txt") +
+                                                        std::chrono::seconds(use_io_uring ? 20 : 10));
+        result = actions::copy_files(cmd);
+        ASSERT_TRUE(result.success);
+        ASSERT_EQ(result.files_affected, 1);
+        ASSERT_TRUE(result.message.find("2 unchanged") != std::string::npos);
+        std::ifstream in(dst / "b.txt");
+        std::string contents;
+        in >> contents;
+        ASSERT_EQ(contents, "B.txt");
+    }
+    
+    // Contents mode sees through a matching size and mtime
+    std::ofstream(dst / "c.txt") << "C.txt";
+    std::filesystem::last_write_time(dst / "c.txt", std::filesystem::last_write_time(src / "c.txt"));
+    actions::Command cmd = {"copy", ".txt", src.string(), dst.string()};
+    cmd.sync = true;
+    auto result = actions::copy_files(cmd);
+    ASSERT_EQ(result.files_affected, 0);
+    cmd.checksum = true;
+    result = actions::copy_files(cmd);
+    ASSERT_EQ(result.files_affected, 1);
+    ASSERT_TRUE(copier::same_contents(src / "c.txt", dst / "c.txt"));
+    
+    std::filesystem::remove_all(src);
+    std::filesystem::remove_all(dst);
+    
+    std::cout << "✓ incremental copy tests passed" << std::endl;
+}
+
+TEST(move_across_devices) {
+    std::cout << "Testing move_across_devices..." << std::endl;
+    
+    // Needs the source on another filesystem than the destination
+    std::filesystem::path src_dir = "/dev/shm/smartfilecmd_test_move_src";
+    std::filesystem::path dst_dir = "/tmp/smartfilecmd_test_move_dst";
+    struct stat shm_st, tmp_st;
+    if (stat("/dev/shm", &shm_st) != 0 || stat("/tmp", &tmp_st) != 0 || shm_st.st_dev == tmp_st.st_dev) {
+        std::cout << "✓ move_across_devices skipped (no second filesystem)" << std::endl;
+        return;
+    }
+    std::filesystem::remove_all(src_dir);
+    std::filesystem::remove_all(dst_dir);
+    std::filesystem::create_directories(src_dir);
+    std::filesystem::create_directories(dst_dir);
+    std::ofstream(src_dir / "a.txt") << "new contents";
+    std::ofstream(dst_dir / "a.txt") << "old";
+    
+    actions::Command cmd = {"move", ".txt", src_dir.string(), dst_dir.string()};
+    cmd.verify = true;
+    auto result = actions::move_files(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.files_affected, 1);
+    ASSERT_FALSE(std::filesystem::exists(src_dir / "a.txt"));
+    std::ifstream moved(dst_dir / "a.txt");
+    std::string contents((std::istreambuf_iterator<char>(moved)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(contents, "new contents");
+    // The copy went through a temporary name that is gone now
+    ASSERT_EQ(std::distance(std::filesystem::directory_iterator(dst_dir), std::filesystem::directory_iterator()), 1);
+    
+    std::filesystem::remove_all(src_dir);
+    std::filesystem::remove_all(dst_dir);
+    
+    std::cout << "✓ move_across_devices tests passed" << std::endl;
+}
+
+TEST(find_duplicates) {
+    std::cout << "Testing find_duplicates..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_duplicates";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir / "sub");
+    
+    // Same size everywhere; the large ones differ only in the middle, which
+    // the edge hashes can't see
+    std::string big(512 * 1024, 'b');
+    std::string other = big;
+    other[256 * 1024] = 'x';
+    std::ofstream(test_dir / "big1.bin") << big;
+    std::ofstream(test_dir / "sub" / "big2.bin") << big;
+    std::ofstream(test_dir / "big3.bin") << other;
+    std::ofstream(test_dir / "small1.txt") << "same";
+    std::ofstream(test_dir / "sub" / "small2.txt") << "same";
+    std::ofstream(test_dir / "small3.txt") << "diff";
+    std::ofstream(test_dir / "empty1.txt");
+    std::ofstream(test_dir / "empty2.txt");
+    std::filesystem::create_hard_link(test_dir / "small3.txt", test_dir / "small3_link.txt");
+    
+    actions::Command cmd = {"find_duplicates", "", test_dir.string(), "", false, false, true};
+    ASSERT_TRUE(actions::validate_command(cmd));
+    auto result = actions::find_duplicates(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.duplicate_groups.size(), 2);
+    ASSERT_EQ(result.duplicate_groups[0].size(), 2);
+    ASSERT_EQ(result.duplicate_groups[0][0], (test_dir / "big1.bin").string());
+    ASSERT_EQ(result.duplicate_groups[0][1], (test_dir / "sub" / "big2.bin").string());
+    ASSERT_EQ(result.duplicate_groups[1][0], (test_dir / "small1.txt").string());
+    ASSERT_EQ(result.files_affected, 2);
+    
+    // Hardlinking leaves one inode per group
+    cmd.dedupe = "hardlink";
+    result = actions::find_duplicates(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_TRUE(result.errors.empty());
+    ASSERT_EQ(result.files_affected, 2);
+    ASSERT_TRUE(std::filesystem::equivalent(test_dir / "big1.bin", test_dir / "sub" / "big2.bin"));
+    ASSERT_TRUE(std::filesystem::equivalent(test_dir / "small1.txt", test_dir / "sub" / "small2.txt"));
+    ASSERT_FALSE(std::filesystem::equivalent(test_dir / "big1.bin", test_dir / "big3.bin"));
+    result = actions::find_duplicates(cmd);
+    ASSERT_EQ(result.duplicate_groups.size(), 0);
+    
+    cmd.dedupe = "symlink";
+    ASSERT_FALSE(actions::find_duplicates(cmd).success);
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ find_duplicates tests passed" << std::endl;
+}
+
+TEST(catalog_index) {
+    std::cout << "Testing catalog_index..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_catalog";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir / "tree" / "sub" / "deep");
+    std::ofstream(test_dir / "tree" / "a.txt") << "a";
+    std::ofstream(test_dir / "tree" / "sub" / "b.txt") << "bb";
+    std::ofstream(test_dir / "tree" / "sub" / "deep" / "c.log") << "ccc";
+    setenv("XDG_CACHE_HOME", (test_dir / "cache").c_str(), 1);
+    
+    // Listings taken right after a change aren't trusted, so age the directories
+    auto past = std::filesystem::file_time_type::clock::now() - std::chrono::minutes(1);
+    for (const char* dir : {"tree", "tree/sub", "tree/sub/deep"}) {
+        std::filesystem::last_write_time(test_dir / dir, past);
+    }
+    
+    actions::Command cmd = {"index", "", (test_dir / "tree").string()};
+    ASSERT_TRUE(actions::validate_command(cmd));
+    auto result = actions::index_tree(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.files_scanned, 5);
+    ASSERT_TRUE(std::filesystem::exists(catalog::location(test_dir / "tree")));
+    
+    // A walk below the indexed root reads nothing from disk
+    auto walk = [&](catalog::Catalog& index, std::vector<std::string>& names) {
+        scanner::WalkOptions options;
+        options.threads = 2;
+        options.cache = &index;
+        std::mutex names_mutex;
+        scanner::walk(test_dir / "tree" / "sub", options,
+            [&](size_t, int, const std::shared_ptr<const scanner::Directory>&,
+                std::span<const scanner::DirEntry> batch) {
+                std::lock_guard<std::mutex> lock(names_mutex);
+                for (const auto& entry : batch) names.emplace_back(entry.name);
+            });
+        std::sort(names.begin(), names.end());
+    };
+    auto index = catalog::open_for(test_dir / "tree" / "sub");
+    ASSERT_EQ(index->root(), test_dir / "tree");
+    std::vector<std::string> names;
+    walk(*index, names);
+    ASSERT_EQ(index->hits(), 2);
+    ASSERT_EQ(index->misses(), 0);
+    ASSERT_EQ(names, (std::vector<std::string>{"b.txt", "c.log", "deep"}));
+    
+    // Extension summaries rule out subtrees with no possible match
+    std::vector<std::string> psd = {"psd"}, log = {"log"};
+    ASSERT_FALSE(index->subtree_may_contain(test_dir / "tree" / "sub", psd));
+    ASSERT_TRUE(index->subtree_may_contain(test_dir / "tree" / "sub", log));
+    ASSERT_EQ(index->pruned(), 1);
+    
+    // Only the changed directory is read again, and the refreshed listing is saved
+    std::ofstream(test_dir / "tree" / "sub" / "deep" / "new.log") << "new";
+    index = catalog::open_for(test_dir / "tree");
+    names.clear();
+    walk(*index, names);
+    ASSERT_EQ(index->hits(), 1);
+    ASSERT_EQ(index->misses(), 1);
+    ASSERT_EQ(names, (std::vector<std::string>{"b.txt", "c.log", "deep", "new.log"}));
+    ASSERT_TRUE(index->subtree_may_contain(test_dir / "tree" / "sub", psd));
+    ASSERT_EQ(index->save(), 0);
+    
+    // A corrupt file is no catalog at all, not a source of wild offsets
+    auto lookup_root = [&](const std::filesystem::path& file) {
+        catalog::Catalog copy(test_dir / "tree", file);
+        struct stat st;
+        lstat((test_dir / "tree").c_str(), &st);
+        return copy.lookup(test_dir / "tree", st, [](std::span<scanner::DirEntry>) {});
+    };
+    std::filesystem::path corrupt = test_dir / "corrupt.idx";
+    std::filesystem::copy_file(index->file(), corrupt);
+    ASSERT_TRUE(lookup_root(corrupt));
+    {
+        std::fstream file(corrupt, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(56);   // first directory record's path offset
+        uint64_t wild = ~uint64_t{0} - 4;
+        file.write(reinterpret_cast<const char*>(&wild), sizeof(wild));
+    }
+    ASSERT_FALSE(lookup_root(corrupt));
+    
+    // Commands consult it with --index
+    cmd = {"hash", ".log", (test_dir / "tree").string(), "", false, false, true};
+    cmd.use_index = true;
+    result = actions::hash_files(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.digests.size(), 2);
+    
+    unsetenv("XDG_CACHE_HOME");
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ catalog_index tests passed" << std::endl;
+}
+
+TEST(watcher_events) {
+    std::cout << "Testing watcher_events..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_watcher";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir / "sub");
+    std::ofstream(test_dir / "a.txt") << "a";
+    
+    catalog::Catalog index(test_dir, test_dir.string() + ".idx", false);
+    watcher::Watcher watch(index);
+    ASSERT_TRUE(watch.ok());
+    ASSERT_TRUE(watch.add(test_dir).empty());
+    ASSERT_EQ(watch.watched(), 2);
+    
+    auto settle = [&](size_t rescans) {
+        for (int i = 0; i < 500 && watch.rescans() < rescans; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_TRUE(watch.rescans() >= rescans);
+    };
+    auto walk = [&] {
+        std::vector<std::string> names;
+        std::mutex names_mutex;
+        scanner::WalkOptions options;
+        options.cache = &index;
+        scanner::walk(test_dir, options,
+            [&](size_t, int, const std::shared_ptr<const scanner::Directory>&,
+                std::span<const scanner::DirEntry> batch) {
+                std::lock_guard<std::mutex> lock(names_mutex);
+                for (const auto& entry : batch) names.emplace_back(entry.name);
+            });
+        std::sort(names.begin(), names.end());
+        return names;
+    };
+    
+    // Fresh listings of watched directories are served despite their new mtimes
+    std::ofstream(test_dir / "sub" / "b.txt") << "b";
+    settle(1);
+    size_t misses = index.misses();
+    ASSERT_EQ(walk(), (std::vector<std::string>{"a.txt", "b.txt", "sub"}));
+    ASSERT_EQ(index.misses(), misses);
+    
+    // New directories are watched along with their contents
+    std::filesystem::create_directories(test_dir / "new" / "deeper");
+    settle(2);
+    for (int i = 0; i < 500 && watch.watched() < 4; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(watch.watched(), 4);
+    
+    // Removed ones are forgotten
+    std::filesystem::remove_all(test_dir / "new");
+    for (int i = 0; i < 500 && watch.watched() > 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(watch.watched(), 2);
+    ASSERT_EQ(walk(), (std::vector<std::string>{"a.txt", "b.txt", "sub"}));
+    
+    // A walk's read that finishes after the watcher's doesn't replace it, and
+    // one landing after an invalidate is checked against the directory
+    catalog::Catalog late(test_dir, test_dir.string() + ".late.idx", false);
+    int dir_fd = scanner::open_directory(test_dir);
+    struct stat before{}, after{};
+    ASSERT_EQ(fstat(dir_fd, &after), 0);
+    before = after;
+    before.st_mtim.tv_sec -= 10;
+    std::vector<scanner::DirEntry> old_entries{{"old.txt", scanner::EntryType::Regular}};
+    std::vector<scanner::DirEntry> new_entries{{"new.txt", scanner::EntryType::Regular}};
+    auto listed = [&](const struct stat& st) {
+        std::vector<std::string> names;
+        bool hit = late.lookup(test_dir, st, [&](std::span<scanner::DirEntry> batch) {
+            for (const auto& entry : batch) names.emplace_back(entry.name);
+        });
+        return hit ? names : std::vector<std::string>{"miss"};
+    };
+    late.watch(test_dir);
+    late.invalidate(test_dir);
+    late.refresh(test_dir, after, dir_fd, new_entries);
+    late.refresh(test_dir, after, dir_fd, {});
+    late.store(test_dir, before, dir_fd, old_entries);
+    late.store(test_dir, before, dir_fd, {});
+    ASSERT_EQ(listed(before), std::vector<std::string>{"new.txt"});
+    late.invalidate(test_dir);
+    late.store(test_dir, before, dir_fd, old_entries);
+    late.store(test_dir, before, dir_fd, {});
+    ASSERT_EQ(listed(after), std::vector<std::string>{"miss"});
+    
+    // A read that failed partway leaves nothing behind for the next one
+    late.refresh(test_dir, after, dir_fd, old_entries);
+    late.discard(test_dir, dir_fd);
+    late.refresh(test_dir, after, dir_fd, new_entries);
+    late.refresh(test_dir, after, dir_fd, {});
+    ASSERT_EQ(listed(after), std::vector<std::string>{"new.txt"});
+    close(dir_fd);
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ watcher_events tests passed" << std::endl;
+}
+
+TEST(server_requests) {
+    std::cout << "Testing server_requests..." << std::endl;
+    
+    // Idle executors are handed out again instead of starting new threads
+    executor::ExecutorPool executors;
+    executor::Executor* first = executors.acquire({}).get();
+    ASSERT_EQ(executors.acquire({}).get(), first);
+    
+    std::filesystem::path socket_path = "/tmp/smartfilecmd_test_server.sock";
+    std::atomic<int> served{0};
+    std::thread server_thread([&] {
+        int err = server::serve(socket_path, [&](const std::string& request) {
+            served++;
+            return "echo " + request;
+        });
+        ASSERT_EQ(err, 0);
+    });
+    
+    int fd = -1;
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, socket_path.c_str());
+    for (int i = 0; i < 500; ++i) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) break;
+        close(fd);
+        fd = -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_TRUE(fd >= 0);
+    
+    // Pipelined requests are answered in order, blank lines skipped
+    std::string requests = "{\"a\":1}\n\n{\"a\":2}\n";
+    ASSERT_EQ(write(fd, requests.data(), requests.size()), static_cast<ssize_t>(requests.size()));
+    std::string responses;
+    char buffer[256];
+    while (std::count(responses.begin(), responses.end(), '\n') < 2) {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        ASSERT_TRUE(n > 0);
+        responses.append(buffer, n);
+    }
+    ASSERT_EQ(responses, "echo {\"a\":1}\necho {\"a\":2}\n");
+    ASSERT_EQ(served.load(), 2);
+    ASSERT_EQ(server::serve(socket_path, [](const std::string&) { return std::string(); }), EADDRINUSE);
+    
+    close(fd);
+    raise(SIGTERM);
+    server_thread.join();
+    ASSERT_FALSE(std::filesystem::exists(socket_path));
+    
+    // Never removes a file that isn't a socket
+    std::filesystem::path not_socket = "/tmp/smartfilecmd_test_server.txt";
+    std::ofstream(not_socket) << "notes";
+    ASSERT_EQ(server::serve(not_socket, [](const std::string&) { return std::string(); }), EEXIST);
+    ASSERT_TRUE(std::filesystem::exists(not_socket));
+    std::filesystem::remove(not_socket);
+    
+    std::cout << "✓ server_requests tests passed" << std::endl;
+}
+
+TEST(batch_shared_listings) {
+    std::cout << "Testing batch_shared_listings..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_batch";
+    std::filesystem::remove_all(test_dir);
+    std::filesystem::create_directories(test_dir / "src");
+    std::filesystem::create_directories(test_dir / "dst");
+    for (const char* name : {"a.txt", "b.txt", "c.log"}) {
+        std::ofstream(test_dir / "src" / name) << name;
+    }
+    
+    // Commands without --index share one catalog, as in --batch
+    server::CatalogRegistry catalogs(false);
+    actions::Resources resources;
+    resources.catalogs = [&](const std::filesystem::path& source) { return catalogs.get(source); };
+    resources.share_listings = true;
+    actions::set_resources(std::move(resources));
+    
+    actions::Command cmd;
+    cmd.action = "move";
+    cmd.pattern = "a.txt";
+    cmd.source = (test_dir / "src").string();
+    cmd.destination = (test_dir / "dst").string();
+    auto result = actions::execute_command(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.files_scanned, 3u);
+    ASSERT_EQ(catalogs.get(test_dir / "src"), catalogs.get(test_dir / "src"));
+    
+    // A listing reused by a later command reflects earlier moves and outside changes
+    std::ofstream(test_dir / "src" / "d.txt") << "d";
+    cmd.pattern = "*.txt";
+    result = actions::execute_command(cmd);
+    actions::set_resources({});
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.files_scanned, 3u);
+    ASSERT_EQ(result.files_affected, 2u);
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "dst" / "d.txt"));
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "src" / "c.log"));
+    
+    std::filesystem::remove_all(test_dir);
+    std::cout << "✓ batch_shared_listings tests passed" << std::endl;
+}
+
+TEST(delete_tree) {
+    std::cout << "Testing delete_tree..." << std::endl;
+    
+    std::filesystem::path test_dir = "/tmp/smartfilecmd_test_delete_tree";
+    std::filesystem::remove_all(test_dir);
+    for (const char* dir : {"a/build/x/y", "a/build/z", "b/src/build", "keep/src"}) {
+        std::filesystem::create_directories(test_dir / dir);
+    }
+    for (int i = 0; i < 200; ++i) {
+        std::ofstream(test_dir / "a/build/x/y" / ("f" + std::to_string(i))) << i;
+    }
+    std::ofstream(test_dir / "a/build/z/g") << "g";
+    std::ofstream(test_dir / "keep/src/main.c") << "int main;";
+    std::filesystem::create_symlink(test_dir / "keep", test_dir / "a/build/link");
+    
+    actions::Command cmd = {"delete_tree", "build", test_dir.string(), "", true, false, true};
+    ASSERT_TRUE(actions::validate_command(cmd));
+    auto result = actions::delete_tree(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_EQ(result.files_matched, 2);
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "a/build/x/y/f0"));
+    
+    cmd.dry_run = false;
+    result = actions::delete_tree(cmd);
+    ASSERT_TRUE(result.success);
+    ASSERT_TRUE(result.errors.empty());
+    ASSERT_EQ(result.files_affected, 202 + 5);
+    ASSERT_TRUE(!std::filesystem::exists(test_dir / "a/build"));
+    ASSERT_TRUE(!std::filesystem::exists(test_dir / "b/src/build"));
+    // Symlinks are removed, not followed
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "keep/src/main.c"));
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "b/src"));
+    
+    // A root swapped for a symlink after it was found loses the link only
+    std::filesystem::create_symlink(test_dir / "keep", test_dir / "swapped");
+    auto stats = remover::remove_trees({test_dir / "swapped"});
+    ASSERT_TRUE(stats.errors.empty());
+    ASSERT_EQ(stats.files, 1);
+    ASSERT_FALSE(std::filesystem::is_symlink(test_dir / "swapped"));
+    ASSERT_TRUE(std::filesystem::exists(test_dir / "keep/src/main.c"));
+    
+    // Never matches everything by accident
+    cmd.pattern = "";
+    ASSERT_FALSE(actions::validate_command(cmd));
+    
+    std::filesystem::remove_all(test_dir);
+    
+    std::cout << "✓ delete_tree tests passed" << std::endl;
+}
+
 TEST(validate_command) {
     std::cout << "Testing validate_command..." << std::endl;
     
@@ -154,7 +1201,27 @@ int main() {
         test_expand_path();
         test_is_safe_directory();
         test_scan_directory();
+        test_scan_directory_recursive();
+        test_stream_files();
+        test_bounded_queue();
         test_matches_pattern();
+        test_glob_matcher();
+        test_extension_set();
+        test_ignore_list();
+        test_parse_size_and_duration();
+        test_copier_copy_file();
+        test_uring_batch_copier();
+        test_uring_metadata_batch();
+        test_executor_device_limits();
+        test_hasher_digests();
+        test_copy_sync();
+        test_move_across_devices();
+        test_find_duplicates();
+        test_delete_tree();
+        test_catalog_index();
+        test_watcher_events();
+        test_server_requests();
+        test_batch_shared_listings();
         test_validate_command();
         test_command_to_string();
         test_create_folder_dry_run();